@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <assert.h>
 
@@ -31,17 +32,18 @@
 #define ARRAY_ERR -1
 
 struct array_item{
-    struct skiplist_node node;
     int index;
     char *value;
+    struct skiplist_node node; //must be last, the tower follows it
 };
 
 struct array{
     struct skiplist sl;
+    struct skiplist_finger finger; //indexes usually come in order, searches resume from the last one
 };
 
 static int array_item_cmp(void *k1, void *k2){
-    struct array_item *i = (struct array_item *)k1, *j = (struct array_item *)k2;
+    struct array_item *i = skiplist_entry(k1, struct array_item, node), *j = skiplist_entry(k2, struct array_item, node);
     return i->index - j->index;
 }
 
@@ -57,6 +59,7 @@ struct array *array_create(){
     struct array *a = calloc(1, sizeof(*a));
     if(NULL == a) goto err;
     skiplist_init((struct skiplist *)a, array_item_cmp);
+    skiplist_finger_init(&a->finger);
     return a;
 
 err:
@@ -65,31 +68,42 @@ err:
     return NULL;
 }
 
+struct array_item *array_item_create(struct array *a){
+    return SKIPLIST_NODE_ALLOC((struct skiplist *)a, struct array_item, node);
+}
+
 struct array_item *array_get(struct array *a, int index){
     struct array_item item = { .index=index, .value=NULL };
-    return (struct array_item *)skiplist_get((struct skiplist *)a, (struct skiplist_node *)&item);
+    struct skiplist_node *node = skiplist_get_hint((struct skiplist *)a, &a->finger, &item.node);
+    return NULL != node ? skiplist_entry(node, struct array_item, node) : NULL;
 }
 
 int array_del(struct array *a, int index){
-    struct array_item *del_item = array_get(a, index);
-    if(NULL != del_item && SKIPLIST_OK == skiplist_del((struct skiplist *)a, (struct skiplist_node *)del_item)){
-        array_item_free(del_item);
+    struct array_item item = { .index=index, .value=NULL };
+    struct skiplist_node *del_node = skiplist_remove_hint((struct skiplist *)a, &a->finger, &item.node);
+    if(NULL != del_node){
+        array_item_free(skiplist_entry(del_node, struct array_item, node));
         return ARRAY_OK;
     }
     return ARRAY_ERR;
 }
 
 int array_set(struct array *a, struct array_item *item){
-    array_del(a, item->index); //try deleting before inserting
-    return SKIPLIST_OK == skiplist_put((struct skiplist *)a, (struct skiplist_node *)item) ? ARRAY_OK : ARRAY_ERR;
+    struct skiplist_node *old_node = NULL;
+    if(SKIPLIST_OK != skiplist_upsert_hint((struct skiplist *)a, &a->finger, &item->node, &old_node)){
+        return ARRAY_ERR;
+    }
+    if(NULL != old_node){ //replaced in place
+        array_item_free(skiplist_entry(old_node, struct array_item, node));
+    }
+    return ARRAY_OK;
 }
 
 void array_free(struct array *a){
     if(NULL == a) return;
     struct skiplist_node *pos, *iter = NULL;
-    SKIPLIST_FOREACH_NEXT((struct skiplist *)a, pos, iter){
-        struct array_item *item = (struct array_item *)pos;
-        array_del(a, item->index);
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)a, pos, iter){ //one pass, no searches
+        array_item_free(skiplist_entry(pos, struct array_item, node));
     }
     free(a);
 }
@@ -102,18 +116,34 @@ struct array_iterator{
 
 struct array_iterator array_iterator_begin(struct array *a, int index){
     struct array_item item = { .index = index };
-    struct skiplist_node *start = skiplist_get((struct skiplist *)a, (struct skiplist_node *)&item);
+    struct skiplist_node *start = skiplist_get((struct skiplist *)a, &item.node);
     return (struct array_iterator){ 
                 .pos = start, 
                 .end = ((struct skiplist *)a)->header
             };
 }
 
+//iterates the indexes in ['from', 'to'] in order
+struct array_iterator array_iterator_range(struct array *a, int from, int to){
+    struct array_item from_item = { .index = from }, to_item = { .index = to };
+    struct skiplist_range range = skiplist_range_begin((struct skiplist *)a, &from_item.node, &to_item.node);
+    return (struct array_iterator){
+                .pos = range.pos,
+                .end = range.end
+            };
+}
+
+//number of indexes in ['from', 'to']
+int array_count(struct array *a, int from, int to){
+    struct array_item from_item = { .index = from }, to_item = { .index = to };
+    return skiplist_range_count((struct skiplist *)a, &from_item.node, &to_item.node);
+}
+
 struct array_item *array_iterator_prev(struct array_iterator *iter){
     struct skiplist_node *curr = iter->pos;
     if(NULL != curr && iter->end != curr){
-        iter->pos = curr->prev[0];
-        return (struct array_item *)curr;
+        iter->pos = curr->prev;
+        return skiplist_entry(curr, struct array_item, node);
     }
     return NULL;
 }
@@ -121,12 +151,222 @@ struct array_item *array_iterator_prev(struct array_iterator *iter){
 struct array_item *array_iterator_next(struct array_iterator *iter){
     struct skiplist_node *curr = iter->pos;
     if(NULL != curr && iter->end != curr){
-        iter->pos = curr->next[0];
-        return (struct array_item *)curr;
+        iter->pos = curr->link[0].next;
+        return skiplist_entry(curr, struct array_item, node);
     }
     return NULL;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// hybrid array
+///////////////////////////////////////////////////////////////////////////////
+//consecutive indexes share one node: a run holds the values of start..start+len-1 in a dense vector,
+//and the list is keyed on the run starts. A lone index is a run of one, a gap starts a new run.
+//Runs grow by appending or prepending and merge when they meet, up to HYBRID_RUN_MAX values, so
+//the memmoves stay bounded
+#define HYBRID_RUN_MAX 1024
+
+struct hybrid_run{
+    int start;
+    int len;
+    int cap;
+    char **values;
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+struct hybrid_array{
+    struct skiplist sl;
+    struct skiplist_finger finger;
+    struct hybrid_run *last; //run of the last get, hits inside it need no search
+};
+
+static int hybrid_run_cmp(void *k1, void *k2){
+    struct hybrid_run *i = skiplist_entry(k1, struct hybrid_run, node), *j = skiplist_entry(k2, struct hybrid_run, node);
+    return (i->start > j->start) - (i->start < j->start);
+}
+
+//one past the last index of 'run', wide enough for a run ending at INT_MAX
+static int64_t hybrid_run_end(struct hybrid_run *run){
+    return (int64_t)run->start + run->len;
+}
+
+static struct hybrid_run *hybrid_run_create(struct hybrid_array *a, int start, int cap){
+    struct hybrid_run *run = SKIPLIST_NODE_ALLOC((struct skiplist *)a, struct hybrid_run, node);
+    if(NULL == run) goto err;
+    if(NULL == (run->values = malloc(cap * sizeof(*run->values)))) goto err;
+    run->start = start;
+    run->cap = cap;
+    return run;
+
+err:
+    if(NULL != run)
+        free(run);
+    return NULL;
+}
+
+//room for 'need' values, doubling up to HYBRID_RUN_MAX
+static int hybrid_run_reserve(struct hybrid_run *run, int need){
+    if(need <= run->cap) return ARRAY_OK;
+    int cap = run->cap * 2 > need ? run->cap * 2 : need;
+    char **values = realloc(run->values, (cap < HYBRID_RUN_MAX ? cap : HYBRID_RUN_MAX) * sizeof(*values));
+    if(NULL == values) return ARRAY_ERR;
+    run->values = values;
+    run->cap = cap < HYBRID_RUN_MAX ? cap : HYBRID_RUN_MAX;
+    return ARRAY_OK;
+}
+
+static void hybrid_run_free(struct hybrid_run *run, int free_values){
+    int i = 0;
+    for(; free_values && i < run->len; i++){
+        free(run->values[i]);
+    }
+    free(run->values);
+    free(run);
+}
+
+struct hybrid_array *hybrid_array_create(){
+    struct hybrid_array *a = calloc(1, sizeof(*a));
+    if(NULL == a) return NULL;
+    skiplist_init((struct skiplist *)a, hybrid_run_cmp);
+    skiplist_finger_init(&a->finger);
+    return a;
+}
+
+//last run starting at or below 'index', NULL if none
+static struct hybrid_run *hybrid_floor(struct hybrid_array *a, int index){
+    struct hybrid_run probe = { .start = index }; //not index + 1, which overflows at INT_MAX
+    skiplist_finger_track((struct skiplist *)a, &a->finger, &probe.node);
+    struct skiplist_node *node = a->finger.tracks[0], *next = node->link[0].next;
+    if(((struct skiplist *)a)->header != next && index == skiplist_entry(next, struct hybrid_run, node)->start){
+        node = next; //tracks[0] stops below 'index', a run starting right at it comes next
+    }
+    return ((struct skiplist *)a)->header != node ? skiplist_entry(node, struct hybrid_run, node) : NULL;
+}
+
+static struct hybrid_run *hybrid_next(struct hybrid_array *a, struct hybrid_run *run){
+    struct skiplist_node *node = (NULL != run ? &run->node : ((struct skiplist *)a)->header)->link[0].next;
+    return ((struct skiplist *)a)->header != node ? skiplist_entry(node, struct hybrid_run, node) : NULL;
+}
+
+static void hybrid_unlink(struct hybrid_array *a, struct hybrid_run *run){
+    skiplist_remove_hint((struct skiplist *)a, &a->finger, &run->node);
+    if(a->last == run) a->last = NULL;
+}
+
+char *hybrid_array_get(struct hybrid_array *a, int index){
+    struct hybrid_run *run = a->last;
+    if(NULL == run || index < run->start || index >= hybrid_run_end(run)){
+        run = hybrid_floor(a, index);
+        if(NULL == run || index >= hybrid_run_end(run)) return NULL;
+        a->last = run;
+    }
+    return run->values[index - run->start];
+}
+
+//takes 'value' (not NULL) and frees the one it replaces
+int hybrid_array_set(struct hybrid_array *a, int index, char *value){
+    if(NULL == value) return ARRAY_ERR;
+    struct hybrid_run *run = hybrid_floor(a, index), *next = NULL;
+    if(NULL != run && index < hybrid_run_end(run)){ //replaced in place
+        free(run->values[index - run->start]);
+        run->values[index - run->start] = value;
+        return ARRAY_OK;
+    }
+    next = hybrid_next(a, run);
+    if(NULL != run && index == hybrid_run_end(run) && run->len < HYBRID_RUN_MAX){ //appended
+        if(ARRAY_OK != hybrid_run_reserve(run, run->len + 1)) return ARRAY_ERR;
+        run->values[run->len++] = value;
+        if(NULL != next && index + 1 == next->start && run->len + next->len <= HYBRID_RUN_MAX &&
+                ARRAY_OK == hybrid_run_reserve(run, run->len + next->len)){ //the gap closed, merge
+            memcpy(run->values + run->len, next->values, next->len * sizeof(*next->values));
+            run->len += next->len;
+            hybrid_unlink(a, next);
+            hybrid_run_free(next, 0);
+        }
+        return ARRAY_OK;
+    }
+    if(NULL != next && index + 1 == next->start && next->len < HYBRID_RUN_MAX){ //prepended, the order holds
+        if(ARRAY_OK != hybrid_run_reserve(next, next->len + 1)) return ARRAY_ERR;
+        memmove(next->values + 1, next->values, next->len * sizeof(*next->values));
+        next->values[0] = value;
+        next->start = index;
+        next->len += 1;
+        return ARRAY_OK;
+    }
+    struct hybrid_run *new_run = hybrid_run_create(a, index, 1);
+    if(NULL == new_run) return ARRAY_ERR;
+    new_run->values[0] = value;
+    new_run->len = 1;
+    skiplist_put_hint((struct skiplist *)a, &a->finger, &new_run->node);
+    return ARRAY_OK;
+}
+
+int hybrid_array_del(struct hybrid_array *a, int index){
+    struct hybrid_run *run = hybrid_floor(a, index);
+    if(NULL == run || index >= hybrid_run_end(run)) return ARRAY_ERR;
+    int k = index - run->start;
+    if(1 == run->len){
+        hybrid_unlink(a, run);
+        hybrid_run_free(run, 1);
+        return ARRAY_OK;
+    }
+    if(0 < k && k < run->len - 1){ //a hole in the middle, the tail becomes a run of its own
+        struct hybrid_run *tail = hybrid_run_create(a, index + 1, run->len - k - 1);
+        if(NULL == tail) return ARRAY_ERR;
+        tail->len = run->len - k - 1;
+        memcpy(tail->values, run->values + k + 1, tail->len * sizeof(*tail->values));
+        free(run->values[k]);
+        run->len = k;
+        skiplist_put_hint((struct skiplist *)a, &a->finger, &tail->node);
+        return ARRAY_OK;
+    }
+    free(run->values[k]);
+    if(0 == k){ //the start moves up, the order holds
+        memmove(run->values, run->values + 1, (run->len - 1) * sizeof(*run->values));
+        run->start += 1;
+    }
+    run->len -= 1;
+    return ARRAY_OK;
+}
+
+void hybrid_array_free(struct hybrid_array *a){
+    if(NULL == a) return;
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)a, pos, iter){
+        hybrid_run_free(skiplist_entry(pos, struct hybrid_run, node), 1);
+    }
+    free(a);
+}
+
+//iterator, no sets or dels while it is open
+struct hybrid_iterator{
+    struct hybrid_array *a;
+    struct hybrid_run *run;
+    int pos; //inside 'run'
+};
+
+//from the first index >= 'index'
+struct hybrid_iterator hybrid_iterator_begin(struct hybrid_array *a, int index){
+    struct hybrid_run *run = hybrid_floor(a, index);
+    if(NULL != run && index < hybrid_run_end(run)){
+        return (struct hybrid_iterator){ .a = a, .run = run, .pos = index - run->start };
+    }
+    return (struct hybrid_iterator){ .a = a, .run = hybrid_next(a, run), .pos = 0 };
+}
+
+//the next value and its index, NULL at the end; within a run it is a plain array walk
+char *hybrid_iterator_next(struct hybrid_iterator *iter, int *index){
+    struct hybrid_run *run = iter->run;
+    if(NULL == run) return NULL;
+    char *value = run->values[iter->pos];
+    *index = run->start + iter->pos;
+    if(++iter->pos >= run->len){
+        iter->run = hybrid_next(iter->a, run);
+        iter->pos = 0;
+    }
+    return value;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // test
 ///////////////////////////////////////////////////////////////////////////////
@@ -135,7 +375,7 @@ void stress_testing(struct array *a, int data_len, int count) {
     int64_t start = getCurrentTime();
     int i = 0;
     for(; i < count; i++){
-        struct array_item *item = calloc(1, sizeof(*item));
+        struct array_item *item = array_item_create(a);
         assert(NULL != item);
         item->index = i;
         assert(NULL != (item->value = random_str(data_len)));
@@ -147,12 +387,177 @@ void stress_testing(struct array *a, int data_len, int count) {
 
 void cover_testing(struct array *a) __attribute__((unused));
 void cover_testing(struct array *a) {
-    struct array_item *new_item = calloc(1, sizeof(*new_item));
+    struct array_item *new_item = array_item_create(a);
     assert(NULL != new_item);
     new_item->index = 0;
     assert(NULL != (new_item->value = strdup("test2")));
     assert(ARRAY_OK == array_set(a, (void *)new_item)); //replace
     assert(new_item == array_get(a, 0));
+
+    //bounded scans stop at the end index
+    assert(10 == array_count(a, 5, 14));
+    assert(0 == array_count(a, 14, 5));
+    int expect = 5;
+    struct array_iterator iterator = array_iterator_range(a, 5, 14);
+    struct array_item *curr = NULL;
+    while(NULL != (curr = array_iterator_next(&iterator))){
+        assert(expect++ == curr->index);
+    }
+    assert(15 == expect);
+    iterator = array_iterator_range(a, 14, 5);
+    assert(NULL == array_iterator_next(&iterator));
+
+    //finger searches jumping backwards, forwards and far away agree with plain searches
+    int probes[] = { 99999, 3, 50000, 49999, 50001, 7, 100001, -1, 12345 };
+    int k = 0;
+    for(; k < sizeof(probes) / sizeof(probes[0]); k++){
+        struct array_item key = { .index = probes[k] };
+        struct skiplist_node *node = skiplist_get((struct skiplist *)a, &key.node);
+        assert(array_get(a, probes[k]) == (NULL != node ? skiplist_entry(node, struct array_item, node) : NULL));
+    }
+
+    //the level histogram adds up to the list, counters are only kept under -DSKIPLIST_STATS
+    struct skiplist_stats stats;
+    int res = skiplist_stats((struct skiplist *)a, &stats), busy = 0, level = 0;
+    for(k = 1; k <= SKIPLIST_MAXLEVEL; k++){
+        busy += stats.levels[k];
+        if(stats.levels[k] > 0) level = k;
+    }
+    assert(busy == stats.busy && level == stats.level && 0 == stats.levels[0]);
+#ifdef SKIPLIST_STATS
+    assert(SKIPLIST_OK == res);
+    unsigned long hops = 0;
+    for(k = 0; k < SKIPLIST_MAXLEVEL; k++){
+        hops += stats.hops[k];
+    }
+    assert(stats.gets > 0 && stats.puts >= stats.busy && hops <= stats.cmps);
+    printf("searches:%lu cmps/search:%.1f hops/search:%.1f puts:%lu gets:%lu dels:%lu level:%d\n", stats.searches,
+            (double)stats.cmps / stats.searches, (double)hops / stats.searches, stats.puts, stats.gets, stats.dels, stats.level);
+    struct array_item key = { .index = 12345 };
+    skiplist_stats_reset((struct skiplist *)a);
+    assert(NULL != skiplist_get((struct skiplist *)a, &key.node));
+    assert(SKIPLIST_OK == skiplist_stats((struct skiplist *)a, &stats));
+    assert(1 == stats.gets && 1 == stats.searches && 0 < stats.cmps && 0 == stats.puts);
+    for(k = 1, res = 0; k <= SKIPLIST_MAXLEVEL; k++){
+        res += stats.levels[k];
+    }
+    assert(res == busy);
+#else
+    assert(SKIPLIST_ERR == res);
+#endif
+}
+
+void hybrid_testing(int count) __attribute__((unused));
+void hybrid_testing(int count) {
+    struct hybrid_array *h = hybrid_array_create();
+    struct array *a = array_create();
+    char **model = calloc(count, sizeof(*model));
+    assert(NULL != h && NULL != a && NULL != model);
+
+    //the dense ids stress_testing uses, against one node per index
+    int i = 0, index = 0;
+    int64_t start = getCurrentTime();
+    for(; i < count; i++){
+        assert(ARRAY_OK == hybrid_array_set(h, i, strdup("v")));
+    }
+    int64_t hybrid_time = getCurrentTime() - start;
+    start = getCurrentTime();
+    for(i = 0; i < count; i++){
+        struct array_item *item = array_item_create(a);
+        assert(NULL != item);
+        item->index = i;
+        item->value = strdup("v");
+        assert(ARRAY_OK == array_set(a, item));
+    }
+    printf("set time consuming:%ld hybrid:%ld count:%d nodes:%d runs:%d\n", getCurrentTime() - start, hybrid_time,
+            count, ((struct skiplist *)a)->busy, ((struct skiplist *)h)->busy);
+    assert((count + HYBRID_RUN_MAX - 1) / HYBRID_RUN_MAX == ((struct skiplist *)h)->busy);
+
+    long sum = 0;
+    int *order = malloc(count * sizeof(*order));
+    assert(NULL != order);
+    for(i = 0; i < count; i++) order[i] = i;
+    for(i = count - 1; i > 0; i--){
+        int j = random() % (i + 1), tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    start = getCurrentTime();
+    for(i = 0; i < count; i++) sum += NULL != array_get(a, order[i]);
+    int64_t array_time = getCurrentTime() - start;
+    start = getCurrentTime();
+    for(i = 0; i < count; i++) sum += NULL != hybrid_array_get(h, order[i]);
+    hybrid_time = getCurrentTime() - start;
+    struct array_iterator iterator = array_iterator_begin(a, 0);
+    start = getCurrentTime();
+    while(NULL != array_iterator_next(&iterator)) sum += 1;
+    int64_t array_scan = getCurrentTime() - start;
+    struct hybrid_iterator hi = hybrid_iterator_begin(h, 0);
+    start = getCurrentTime();
+    while(NULL != hybrid_iterator_next(&hi, &index)) sum += 1;
+    printf("random get time consuming:%ld hybrid:%ld scan:%ld hybrid:%ld (%ld)\n", array_time, hybrid_time,
+            array_scan, getCurrentTime() - start, sum);
+    assert(4L * count == sum);
+    array_free(a);
+    hybrid_array_free(h);
+
+    //random sets and dels against a model: gaps, merges, splits and runs of one
+    h = hybrid_array_create();
+    assert(NULL != h && ARRAY_ERR == hybrid_array_set(h, 0, NULL));
+    for(i = 0; i < count * 4; i++){
+        int k = random() % count;
+        if(random() % 3){
+            char *value = strdup("x");
+            assert(ARRAY_OK == hybrid_array_set(h, k, value));
+            model[k] = value;
+        }else{
+            assert((NULL != model[k] ? ARRAY_OK : ARRAY_ERR) == hybrid_array_del(h, k));
+            model[k] = NULL;
+        }
+    }
+    int expect = 0;
+    for(i = 0; i < count; i++){
+        assert(model[i] == hybrid_array_get(h, i));
+        expect += NULL != model[i];
+    }
+    assert(NULL == hybrid_array_get(h, -1) && NULL == hybrid_array_get(h, count));
+    char *value = NULL;
+    int seen = 0, prev = -1;
+    hi = hybrid_iterator_begin(h, count / 2);
+    for(i = count / 2; i < count && NULL == model[i]; i++);
+    while(NULL != (value = hybrid_iterator_next(&hi, &index))){ //in order, from the first index >= count / 2
+        assert(index > prev && (-1 != prev || index == i) && model[index] == value);
+        prev = index;
+        seen += 1;
+    }
+    for(i = count / 2; i < count; i++) seen -= NULL != model[i];
+    assert(0 == seen && expect > 0);
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)h, pos, iter){ //runs never overlap, they may touch after a full one
+        struct hybrid_run *run = skiplist_entry(pos, struct hybrid_run, node), *next = hybrid_next(h, run);
+        assert(run->len > 0 && run->len <= run->cap && run->cap <= HYBRID_RUN_MAX);
+        assert(NULL == next || next->start >= hybrid_run_end(run));
+    }
+    hybrid_array_free(h);
+
+    //the ends of the int range
+    h = hybrid_array_create();
+    assert(NULL != h);
+    int edges[] = { INT_MAX, INT_MAX - 1, INT_MIN, INT_MIN + 1 };
+    for(i = 0; i < 4; i++){
+        assert(ARRAY_OK == hybrid_array_set(h, edges[i], strdup("edge")));
+    }
+    assert(2 == ((struct skiplist *)h)->busy && NULL == hybrid_array_get(h, 0));
+    for(i = 0; i < 4; i++){
+        assert(NULL != hybrid_array_get(h, edges[i]));
+    }
+    hi = hybrid_iterator_begin(h, INT_MAX);
+    assert(NULL != hybrid_iterator_next(&hi, &index) && INT_MAX == index && NULL == hybrid_iterator_next(&hi, &index));
+    assert(ARRAY_OK == hybrid_array_del(h, INT_MAX) && NULL == hybrid_array_get(h, INT_MAX));
+    assert(ARRAY_OK == hybrid_array_del(h, INT_MIN) && NULL != hybrid_array_get(h, INT_MIN + 1));
+    hybrid_array_free(h);
+    free(model);
+    free(order);
 }
 
 int main(){
@@ -160,6 +565,7 @@ int main(){
 
     stress_testing(a, 32, 100000);
     cover_testing(a);
+    hybrid_testing(100000);
 
     int i = 0;
     struct array_iterator iterator = array_iterator_begin(a, 100);
@@ -0,0 +1,418 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE //tdestroy
+
+//benchmark harness: int keys, a preloaded structure and a mixed get/put/del stream
+//
+//  ./bench [-n size] [-o ops] [-w warmup] [-d seq|uniform|zipf] [-t theta] [-r read%] [-f text|csv|json]
+//
+//the key space is twice the size and half of it is preloaded, writes are half puts and half dels so the
+//size stays around 'size'. Every structure sees the same op stream: one pass is timed as a whole for the
+//throughput, a second one times every op for the latency histograms
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <search.h>
+#include <getopt.h>
+
+#include "utils.h"
+#include "skiplist.h"
+#include "skiplist_block.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// latency histogram, log-linear: 32 buckets per power of two, about 3% wide
+///////////////////////////////////////////////////////////////////////////////
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+struct hist{
+    long count;
+    int64_t sum;
+    int64_t max;
+    long buckets[HIST_BUCKETS];
+};
+
+static int hist_bucket(int64_t v){
+    if(v < (1 << HIST_SUB_BITS)) return (int)v;
+    int exp = 63 - __builtin_clzll((uint64_t)v); //>= HIST_SUB_BITS
+    int sub = (int)(v >> (exp - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    return ((exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+//lowest value of a bucket
+static int64_t hist_value(int bucket){
+    if(bucket < (1 << HIST_SUB_BITS)) return bucket;
+    int exp = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    int64_t sub = bucket & ((1 << HIST_SUB_BITS) - 1);
+    return ((int64_t)1 << exp) + (sub << (exp - HIST_SUB_BITS));
+}
+
+static void hist_add(struct hist *h, int64_t v){
+    if(v < 0) v = 0;
+    h->buckets[hist_bucket(v)] += 1;
+    h->count += 1;
+    h->sum += v;
+    if(v > h->max) h->max = v;
+}
+
+static void hist_merge(struct hist *dst, struct hist *src){
+    int i = 0;
+    for(; i < HIST_BUCKETS; i++){
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if(src->max > dst->max) dst->max = src->max;
+}
+
+static int64_t hist_percentile(struct hist *h, double p){
+    long rank = (long)ceil(p * h->count), seen = 0;
+    int i = 0;
+    for(; i < HIST_BUCKETS; i++){
+        seen += h->buckets[i];
+        if(seen >= rank && seen > 0) return hist_value(i);
+    }
+    return h->max;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// key streams
+///////////////////////////////////////////////////////////////////////////////
+enum{ DIST_SEQ, DIST_UNIFORM, DIST_ZIPF };
+enum{ OP_GET, OP_PUT, OP_DEL, OP_COUNT };
+static const char *op_names[OP_COUNT] = { "get", "put", "del" };
+
+struct stream{
+    int dist;
+    int space;
+    int read_percent;
+    uint64_t seed;
+    long next; //sequential position
+    double theta, alpha, zetan, eta; //zipfian, Gray et al. as in YCSB
+};
+
+static inline uint64_t xorshift64(uint64_t *s){
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+static double random_unit(uint64_t *s){
+    return (xorshift64(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void stream_init(struct stream *st, int dist, int space, int read_percent, double theta, uint64_t seed){
+    memset(st, 0, sizeof(*st));
+    st->dist = dist;
+    st->space = space;
+    st->read_percent = read_percent;
+    st->seed = seed;
+    if(DIST_ZIPF == dist){
+        double zeta2 = 1.0 + pow(0.5, theta);
+        int i = 1;
+        for(; i <= space; i++){
+            st->zetan += 1.0 / pow(i, theta);
+        }
+        st->theta = theta;
+        st->alpha = 1.0 / (1.0 - theta);
+        st->eta = (1.0 - pow(2.0 / space, 1.0 - theta)) / (1.0 - zeta2 / st->zetan);
+    }
+}
+
+static int stream_key(struct stream *st){
+    if(DIST_SEQ == st->dist){
+        return (int)(st->next++ % st->space);
+    }
+    if(DIST_UNIFORM == st->dist){
+        return (int)(xorshift64(&st->seed) % st->space);
+    }
+    double u = random_unit(&st->seed), uz = u * st->zetan;
+    long rank = uz < 1.0 ? 0 : (uz < 1.0 + pow(0.5, st->theta) ? 1 :
+                    (long)(st->space * pow(st->eta * u - st->eta + 1.0, st->alpha)));
+    if(rank >= st->space) rank = st->space - 1;
+    return (int)(((uint64_t)rank * 0x9E3779B97F4A7C15ULL >> 17) % st->space); //hot keys spread over the space
+}
+
+static int stream_op(struct stream *st){
+    int r = (int)(xorshift64(&st->seed) % 200);
+    if(r < st->read_percent * 2) return OP_GET;
+    return (r & 1) ? OP_PUT : OP_DEL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// structures under test
+///////////////////////////////////////////////////////////////////////////////
+struct target{
+    const char *name;
+    void (*init)(void *self);
+    int (*op)(void *self, int op, int key); //1 if the key was there
+    void (*destroy)(void *self);
+};
+
+struct sl_item{
+    int key;
+    void *value;
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+static int sl_item_cmp(void *k1, void *k2){
+    struct sl_item *i = skiplist_entry(k1, struct sl_item, node), *j = skiplist_entry(k2, struct sl_item, node);
+    return (i->key > j->key) - (i->key < j->key);
+}
+
+static uint64_t level_seed; //-s, tower heights repeat run after run
+
+static void sl_init(void *self){
+    skiplist_init((struct skiplist *)self, sl_item_cmp);
+    skiplist_seed((struct skiplist *)self, level_seed);
+}
+
+static int sl_op(void *self, int op, int key){
+    struct skiplist *sl = self;
+    struct sl_item probe = { .key = key };
+    struct skiplist_node *node = NULL;
+    if(OP_GET == op){
+        return NULL != skiplist_get(sl, &probe.node);
+    }
+    if(OP_PUT == op){
+        struct sl_item *item = SKIPLIST_NODE_ALLOC(sl, struct sl_item, node);
+        assert(NULL != item);
+        item->key = key;
+        assert(SKIPLIST_OK == skiplist_upsert(sl, &item->node, &node));
+    }else{
+        node = skiplist_remove(sl, &probe.node);
+    }
+    if(NULL != node) free(skiplist_entry(node, struct sl_item, node));
+    return NULL != node;
+}
+
+static void sl_destroy(void *self){
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)self, pos, iter){
+        free(skiplist_entry(pos, struct sl_item, node));
+    }
+}
+
+static void block_init(void *self){
+    bskiplist_init((struct bskiplist *)self);
+}
+
+static int block_op(void *self, int op, int key){
+    void *value = NULL;
+    if(OP_GET == op) return SKIPLIST_OK == bskiplist_get((struct bskiplist *)self, key, &value);
+    if(OP_PUT == op) return SKIPLIST_OK == bskiplist_put((struct bskiplist *)self, key, NULL);
+    return SKIPLIST_OK == bskiplist_del((struct bskiplist *)self, key, &value);
+}
+
+static void block_destroy(void *self){
+    bskiplist_destroy((struct bskiplist *)self);
+}
+
+//red-black tree baseline: glibc tsearch, the key is stored in the pointer itself
+static int rb_cmp(const void *a, const void *b){
+    intptr_t i = (intptr_t)a, j = (intptr_t)b;
+    return (i > j) - (i < j);
+}
+
+static void rb_init(void *self){
+    *(void **)self = NULL;
+}
+
+static int rb_op(void *self, int op, int key){
+    void *k = (void *)(intptr_t)key;
+    if(OP_GET == op) return NULL != tfind(k, (void **)self, rb_cmp);
+    if(OP_PUT == op){
+        void **res = tsearch(k, (void **)self, rb_cmp);
+        assert(NULL != res);
+        return *res != k; //never true, keys are their own values
+    }
+    return NULL != tdelete(k, (void **)self, rb_cmp);
+}
+
+static void rb_noop(void *node){
+    (void)node;
+}
+
+static void rb_destroy(void *self){
+    tdestroy(*(void **)self, rb_noop);
+}
+
+static struct target targets[] = {
+    { "skiplist", sl_init, sl_op, sl_destroy },
+    { "block", block_init, block_op, block_destroy },
+    { "rbtree", rb_init, rb_op, rb_destroy },
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// runner
+///////////////////////////////////////////////////////////////////////////////
+struct config{
+    int size;
+    long ops;
+    long warmup;
+    int dist;
+    double theta;
+    int read_percent;
+    int format;
+};
+
+enum{ FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+static const char *dist_names[] = { "seq", "uniform", "zipf" };
+
+struct result{
+    double mops;
+    struct hist hists[OP_COUNT + 1]; //the last one is every op
+};
+
+static void run(struct config *cfg, struct target *t, struct result *res){
+    union{
+        struct skiplist sl;
+        struct bskiplist bsl;
+        void *root;
+    } self;
+    struct stream st;
+    int i = 0;
+    long n = 0;
+    memset(res, 0, sizeof(*res));
+    skiplist_thread_seed(level_seed); //the block list draws from the thread's generator
+    t->init(&self);
+
+    int *keys = malloc(sizeof(*keys) * cfg->size); //even keys in random order
+    assert(NULL != keys);
+    for(i = 0; i < cfg->size; i++) keys[i] = i * 2;
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    for(i = cfg->size - 1; i > 0; i--){
+        int j = (int)(xorshift64(&seed) % (i + 1)), tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    for(i = 0; i < cfg->size; i++) t->op(&self, OP_PUT, keys[i]);
+    free(keys);
+
+    stream_init(&st, cfg->dist, cfg->size * 2, cfg->read_percent, cfg->theta, 88172645463325252ULL);
+    for(n = 0; n < cfg->warmup; n++){
+        t->op(&self, stream_op(&st), stream_key(&st));
+    }
+
+    long hits = 0;
+    int64_t start = getCurrentTimeNs();
+    for(n = 0; n < cfg->ops; n++){
+        hits += t->op(&self, stream_op(&st), stream_key(&st));
+    }
+    int64_t elapsed = getCurrentTimeNs() - start;
+    res->mops = elapsed > 0 ? cfg->ops * 1e3 / elapsed : 0;
+
+    for(n = 0; n < cfg->ops; n++){
+        int op = stream_op(&st), key = stream_key(&st);
+        int64_t begin = getCurrentTimeNs();
+        hits += t->op(&self, op, key);
+        hist_add(&res->hists[op], getCurrentTimeNs() - begin);
+    }
+    for(i = 0; i < OP_COUNT; i++){
+        hist_merge(&res->hists[OP_COUNT], &res->hists[i]);
+    }
+    t->destroy(&self);
+    (void)hits;
+}
+
+static void print_header(struct config *cfg){
+    if(FORMAT_TEXT == cfg->format){
+        printf("size:%d ops:%ld warmup:%ld dist:%s reads:%d%%\n", cfg->size, cfg->ops, cfg->warmup,
+                dist_names[cfg->dist], cfg->read_percent);
+        printf("%-10s %-4s %10s %8s %8s %8s %8s %8s %10s\n", "structure", "op", "ops", "Mops/s",
+                "mean ns", "p50 ns", "p99 ns", "p999 ns", "max ns");
+    }else if(FORMAT_CSV == cfg->format){
+        printf("structure,op,dist,size,read_pct,ops,mops,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }else{
+        printf("[\n");
+    }
+}
+
+static void print_row(struct config *cfg, const char *name, const char *op, struct hist *h, double mops, int last){
+    double mean = h->count > 0 ? (double)h->sum / h->count : 0;
+    int64_t p50 = hist_percentile(h, 0.5), p99 = hist_percentile(h, 0.99), p999 = hist_percentile(h, 0.999);
+    if(FORMAT_TEXT == cfg->format){
+        char buf[16] = "";
+        if(mops > 0) snprintf(buf, sizeof(buf), "%.2f", mops);
+        printf("%-10s %-4s %10ld %8s %8.1f %8ld %8ld %8ld %10ld\n", name, op, h->count, buf, mean,
+                (long)p50, (long)p99, (long)p999, (long)h->max);
+    }else if(FORMAT_CSV == cfg->format){
+        printf("%s,%s,%s,%d,%d,%ld,", name, op, dist_names[cfg->dist], cfg->size, cfg->read_percent, h->count);
+        if(mops > 0) printf("%.3f", mops);
+        printf(",%.1f,%ld,%ld,%ld,%ld\n", mean, (long)p50, (long)p99, (long)p999, (long)h->max);
+    }else{
+        printf("  {\"structure\":\"%s\",\"op\":\"%s\",\"dist\":\"%s\",\"size\":%d,\"read_pct\":%d,\"ops\":%ld,",
+                name, op, dist_names[cfg->dist], cfg->size, cfg->read_percent, h->count);
+        if(mops > 0) printf("\"mops\":%.3f,", mops);
+        printf("\"mean_ns\":%.1f,\"p50_ns\":%ld,\"p99_ns\":%ld,\"p999_ns\":%ld,\"max_ns\":%ld}%s\n",
+                mean, (long)p50, (long)p99, (long)p999, (long)h->max, last ? "" : ",");
+    }
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-n size] [-o ops] [-w warmup] [-d seq|uniform|zipf] [-t theta] [-r read%%] [-f text|csv|json] [-s seed]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv){
+    struct config cfg = { .size = 1000000, .ops = 1000000, .warmup = 100000, .dist = DIST_UNIFORM,
+                            .theta = 0.99, .read_percent = 90, .format = FORMAT_TEXT };
+    int opt = 0;
+    while(-1 != (opt = getopt(argc, argv, "n:o:w:d:t:r:f:s:"))){
+        switch(opt){
+        case 'n': cfg.size = atoi(optarg); break;
+        case 'o': cfg.ops = atol(optarg); break;
+        case 'w': cfg.warmup = atol(optarg); break;
+        case 't': cfg.theta = atof(optarg); break;
+        case 'r': cfg.read_percent = atoi(optarg); break;
+        case 's': level_seed = strtoull(optarg, NULL, 0); break;
+        case 'd':
+            if(0 == strcmp(optarg, "seq")) cfg.dist = DIST_SEQ;
+            else if(0 == strcmp(optarg, "uniform")) cfg.dist = DIST_UNIFORM;
+            else if(0 == strcmp(optarg, "zipf")) cfg.dist = DIST_ZIPF;
+            else usage(argv[0]);
+            break;
+        case 'f':
+            if(0 == strcmp(optarg, "text")) cfg.format = FORMAT_TEXT;
+            else if(0 == strcmp(optarg, "csv")) cfg.format = FORMAT_CSV;
+            else if(0 == strcmp(optarg, "json")) cfg.format = FORMAT_JSON;
+            else usage(argv[0]);
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if(cfg.size < 1 || cfg.ops < 1 || cfg.read_percent < 0 || cfg.read_percent > 100 ||
+            cfg.theta <= 0 || cfg.theta >= 1) usage(argv[0]);
+
+    static struct result res;
+    int count = sizeof(targets) / sizeof(targets[0]), i = 0, op = 0;
+    print_header(&cfg);
+    for(; i < count; i++){
+        run(&cfg, &targets[i], &res);
+        print_row(&cfg, targets[i].name, "all", &res.hists[OP_COUNT], res.mops, 0);
+        for(op = 0; op < OP_COUNT; op++){
+            print_row(&cfg, targets[i].name, op_names[op], &res.hists[op], 0, i == count - 1 && op == OP_COUNT - 1);
+        }
+    }
+    if(FORMAT_JSON == cfg.format) printf("]\n");
+    return 0;
+}
@@ -0,0 +1,304 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "utils.h"
+#include "bitcask.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// index
+///////////////////////////////////////////////////////////////////////////////
+#define BITCASK_WINDOW_MIN (1 << 20)
+#define BITCASK_WRITE_BUF (1 << 16)
+
+//a lookup key: an entry with an empty tower and the key right behind it, as stored entries have
+union bitcask_probe{
+    struct bitcask_entry entry;
+    char buf[sizeof(struct bitcask_entry) + BITCASK_MAX_KEY_LEN + 1];
+};
+
+static int bitcask_entry_cmp(void *k1, void *k2){
+    return strcmp(skiplist_node_tail(k1), skiplist_node_tail(k2));
+}
+
+static struct skiplist_node *bitcask_probe_init(union bitcask_probe *probe, const char *key, size_t key_len){
+    if(0 == key_len || key_len > BITCASK_MAX_KEY_LEN) return NULL;
+    probe->entry.node.level = 0;
+    probe->entry.key_len = key_len;
+    char *tail = skiplist_node_tail(&probe->entry.node);
+    memcpy(tail, key, key_len);
+    tail[key_len] = '\0';
+    return &probe->entry.node;
+}
+
+static struct bitcask_entry *bitcask_find(struct bitcask *bc, const char *key){
+    union bitcask_probe probe;
+    struct skiplist_node *node = bitcask_probe_init(&probe, key, strlen(key));
+    if(NULL == node || NULL == (node = skiplist_get(&bc->sl, node))) return NULL;
+    return skiplist_entry(node, struct bitcask_entry, node);
+}
+
+static uint64_t bitcask_record_size(uint32_t key_len, uint32_t value_len){
+    return sizeof(struct bitcask_record) + key_len + (BITCASK_TOMBSTONE == value_len ? 0 : value_len);
+}
+
+static void bitcask_entry_free(struct bitcask *bc, struct bitcask_entry *entry){
+    bc->garbage += bitcask_record_size(entry->key_len, entry->value_len);
+    skiplist_arena_free(&bc->arena, entry, skiplist_node_size(sizeof(*entry), offsetof(struct bitcask_entry, node),
+                            entry->node.level) + entry->key_len + 1);
+}
+
+//points the index at the record at 'pos', whose bytes are already in the log
+static int bitcask_index(struct bitcask *bc, const char *key, uint32_t key_len, uint64_t pos, uint32_t value_len){
+    if(BITCASK_TOMBSTONE == value_len){
+        union bitcask_probe probe;
+        struct skiplist_node *node = bitcask_probe_init(&probe, key, key_len);
+        if(NULL == node) return BITCASK_ERR;
+        if(NULL != (node = skiplist_remove(&bc->sl, node))){
+            bitcask_entry_free(bc, skiplist_entry(node, struct bitcask_entry, node));
+        }
+        bc->garbage += bitcask_record_size(key_len, value_len);
+        return BITCASK_OK;
+    }
+    struct bitcask_entry *entry = SKIPLIST_NODE_ALLOC_ARENA(&bc->sl, &bc->arena, struct bitcask_entry, node, key_len + 1);
+    struct skiplist_node *old = NULL;
+    if(NULL == entry) return BITCASK_ERR;
+    entry->value_pos = pos + sizeof(struct bitcask_record) + key_len;
+    entry->value_len = value_len;
+    entry->key_len = key_len;
+    memcpy(skiplist_node_tail(&entry->node), key, key_len); //zeroed, so terminated
+    skiplist_upsert(&bc->sl, &entry->node, &old);
+    if(NULL != old){
+        bitcask_entry_free(bc, skiplist_entry(old, struct bitcask_entry, node));
+    }
+    return BITCASK_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// log
+///////////////////////////////////////////////////////////////////////////////
+//maps at least 'need' bytes of 'fd', with room for the log to grow into before the next remap
+static int bitcask_map(int fd, uint64_t need, char **window, size_t *window_len){
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t len = need * 2 > BITCASK_WINDOW_MIN ? need * 2 : BITCASK_WINDOW_MIN;
+    len = (len + page - 1) / page * page;
+    void *res = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0); //pages past the end are never touched
+    if(MAP_FAILED == res) return BITCASK_ERR;
+    *window = res;
+    *window_len = len;
+    return BITCASK_OK;
+}
+
+static int bitcask_append(struct bitcask *bc, const char *key, uint32_t key_len, const void *value, uint32_t value_len){
+    struct bitcask_record record = { key_len, value_len };
+    uint32_t len = BITCASK_TOMBSTONE == value_len ? 0 : value_len;
+    struct iovec iov[3] = { { &record, sizeof(record) }, { (void *)key, key_len }, { (void *)value, len } };
+    uint64_t size = bitcask_record_size(key_len, value_len), pos = bc->tail;
+    if(size > bc->window_len - bc->tail){ //remapped before the write, so a failure leaves the log untouched
+        char *window = NULL;
+        size_t window_len = 0;
+        if(BITCASK_OK != bitcask_map(bc->fd, bc->tail + size, &window, &window_len)) return BITCASK_ERR;
+        munmap(bc->window, bc->window_len);
+        bc->window = window;
+        bc->window_len = window_len;
+    }
+    if((ssize_t)size != pwritev(bc->fd, iov, 3, pos)){
+        int res = ftruncate(bc->fd, pos); //drop a partial record, the next append overwrites it anyway
+        (void)res;
+        return BITCASK_ERR;
+    }
+    bc->tail += size;
+    return bitcask_index(bc, key, key_len, pos, value_len);
+}
+
+//indexes every complete record, 'bc->tail' ends after the last one
+static int bitcask_replay(struct bitcask *bc, uint64_t size){
+    uint64_t pos = 0;
+    while(pos + sizeof(struct bitcask_record) <= size){
+        struct bitcask_record record;
+        memcpy(&record, bc->window + pos, sizeof(record)); //records are not aligned
+        uint64_t end = pos + bitcask_record_size(record.key_len, record.value_len);
+        if(0 == record.key_len || record.key_len > BITCASK_MAX_KEY_LEN || end > size) break;
+        if(BITCASK_OK != bitcask_index(bc, bc->window + pos + sizeof(record), record.key_len, pos, record.value_len)){
+            return BITCASK_ERR;
+        }
+        pos = end;
+    }
+    bc->tail = pos;
+    if(pos < size && 0 != ftruncate(bc->fd, pos)) return BITCASK_ERR; //torn or garbled end
+    return BITCASK_OK;
+}
+
+struct bitcask *bitcask_open(const char *path){
+    struct stat st;
+    struct bitcask *bc = calloc(1, sizeof(*bc));
+    if(NULL == bc) return NULL;
+    bc->fd = -1;
+    skiplist_init(&bc->sl, bitcask_entry_cmp);
+    skiplist_arena_init(&bc->arena, 0);
+    if(NULL == (bc->path = strdup(path))) goto err;
+    if(0 > (bc->fd = open(path, O_RDWR | O_CREAT, 0644))) goto err;
+    if(0 != fstat(bc->fd, &st)) goto err;
+    if(BITCASK_OK != bitcask_map(bc->fd, st.st_size, &bc->window, &bc->window_len)) goto err;
+    if(BITCASK_OK != bitcask_replay(bc, st.st_size)) goto err;
+    return bc;
+
+err:
+    bitcask_close(bc);
+    return NULL;
+}
+
+void bitcask_close(struct bitcask *bc){
+    if(NULL == bc) return;
+    if(NULL != bc->window) munmap(bc->window, bc->window_len);
+    if(0 <= bc->fd) close(bc->fd);
+    skiplist_destroy(&bc->sl);
+    skiplist_arena_destroy(&bc->arena);
+    free(bc->path);
+    free(bc);
+}
+
+int bitcask_put(struct bitcask *bc, const char *key, const void *value, uint32_t value_len){
+    size_t key_len = strlen(key);
+    if(0 == key_len || key_len > BITCASK_MAX_KEY_LEN || BITCASK_TOMBSTONE == value_len) return BITCASK_ERR;
+    return bitcask_append(bc, key, key_len, value, value_len);
+}
+
+int bitcask_del(struct bitcask *bc, const char *key){
+    if(NULL == bitcask_find(bc, key)) return BITCASK_ERR;
+    return bitcask_append(bc, key, strlen(key), NULL, BITCASK_TOMBSTONE);
+}
+
+char *bitcask_get(struct bitcask *bc, const char *key, uint32_t *value_len){
+    struct bitcask_entry *entry = bitcask_find(bc, key);
+    if(NULL == entry) return NULL;
+    *value_len = entry->value_len;
+    return read_value_from_file(bc->fd, entry->value_len, entry->value_pos);
+}
+
+const char *bitcask_get_borrowed(struct bitcask *bc, const char *key, uint32_t *value_len){
+    struct bitcask_entry *entry = bitcask_find(bc, key);
+    if(NULL == entry) return NULL;
+    *value_len = entry->value_len;
+    return bc->window + entry->value_pos;
+}
+
+int bitcask_sync(struct bitcask *bc){
+    return 0 == fdatasync(bc->fd) ? BITCASK_OK : BITCASK_ERR;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// compaction
+///////////////////////////////////////////////////////////////////////////////
+struct bitcask_writer{
+    int fd;
+    size_t used;
+    char buf[BITCASK_WRITE_BUF];
+};
+
+static int bitcask_writer_flush(struct bitcask_writer *w){
+    char *p = w->buf;
+    while(w->used > 0){
+        ssize_t n = write(w->fd, p, w->used);
+        if(n < 0 && EINTR == errno) continue;
+        if(n <= 0) return BITCASK_ERR;
+        p += n;
+        w->used -= n;
+    }
+    return BITCASK_OK;
+}
+
+static int bitcask_writer_add(struct bitcask_writer *w, const void *data, size_t len){
+    const char *p = data;
+    while(len > 0){
+        size_t n = BITCASK_WRITE_BUF - w->used < len ? BITCASK_WRITE_BUF - w->used : len;
+        memcpy(w->buf + w->used, p, n);
+        w->used += n;
+        p += n;
+        len -= n;
+        if(BITCASK_WRITE_BUF == w->used && BITCASK_OK != bitcask_writer_flush(w)) return BITCASK_ERR;
+    }
+    return BITCASK_OK;
+}
+
+int bitcask_compact(struct bitcask *bc){
+    size_t len = strlen(bc->path);
+    struct bitcask_writer *w = NULL;
+    char *tmp = NULL, *window = NULL;
+    size_t window_len = 0;
+    uint64_t size = 0;
+    int fd = -1;
+    struct skiplist_node *pos, *iter = NULL;
+    if(NULL == (tmp = malloc(len + 9))) goto err;
+    memcpy(tmp, bc->path, len);
+    memcpy(tmp + len, ".compact", 9);
+    if(NULL == (w = malloc(sizeof(*w)))) goto err;
+    if(0 > (fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644))) goto err;
+    w->fd = fd;
+    w->used = 0;
+    SKIPLIST_FOREACH_NEXT(&bc->sl, pos, iter){ //key order, the values come straight from the old window
+        struct bitcask_entry *entry = skiplist_entry(pos, struct bitcask_entry, node);
+        struct bitcask_record record = { entry->key_len, entry->value_len };
+        if(BITCASK_OK != bitcask_writer_add(w, &record, sizeof(record)) ||
+                BITCASK_OK != bitcask_writer_add(w, skiplist_node_tail(pos), entry->key_len) ||
+                BITCASK_OK != bitcask_writer_add(w, bc->window + entry->value_pos, entry->value_len)){
+            goto err;
+        }
+        size += bitcask_record_size(entry->key_len, entry->value_len);
+    }
+    if(BITCASK_OK != bitcask_writer_flush(w) || 0 != fsync(fd)) goto err;
+    if(BITCASK_OK != bitcask_map(fd, size, &window, &window_len)) goto err;
+    if(0 != rename(tmp, bc->path)){
+        munmap(window, window_len);
+        goto err;
+    }
+
+    munmap(bc->window, bc->window_len); //nothing can fail from here on
+    close(bc->fd);
+    bc->window = window;
+    bc->window_len = window_len;
+    bc->fd = fd;
+    bc->tail = size;
+    bc->garbage = 0;
+    size = 0;
+    iter = NULL;
+    SKIPLIST_FOREACH_NEXT(&bc->sl, pos, iter){ //same order and sizes as written
+        struct bitcask_entry *entry = skiplist_entry(pos, struct bitcask_entry, node);
+        entry->value_pos = size + sizeof(struct bitcask_record) + entry->key_len;
+        size += bitcask_record_size(entry->key_len, entry->value_len);
+    }
+    free(w);
+    free(tmp);
+    return BITCASK_OK;
+
+err:
+    if(0 <= fd){
+        close(fd);
+        unlink(tmp);
+    }
+    free(w);
+    free(tmp);
+    return BITCASK_ERR;
+}
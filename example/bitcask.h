@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __BITCASK_H_
+#define __BITCASK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "skiplist.h"
+#include "skiplist_arena.h"
+
+//bitcask-style store: values live in an append-only log, the list keeps only the keys and where
+//their latest value sits. Opening replays the log, compaction rewrites it with the live values only.
+//One writer; gets only read the log (pread or the mapped window) and may run side by side
+#define BITCASK_OK 0
+#define BITCASK_ERR -1
+#define BITCASK_MAX_KEY_LEN 256
+#define BITCASK_TOMBSTONE UINT32_MAX //value_len of a delete record
+
+//log record: this header, the key bytes, then the value bytes
+struct bitcask_record{
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+struct bitcask_entry{
+    uint64_t value_pos; //offset of the value bytes in the log
+    uint32_t value_len;
+    uint32_t key_len;
+    struct skiplist_node node; //must be last, the key follows the tower
+};
+
+struct bitcask{
+    struct skiplist sl;
+    struct skiplist_arena arena; //entries, dropped at once on close
+    char *path;
+    int fd;
+    uint64_t tail;    //end of the log
+    uint64_t garbage; //log bytes held by overwritten and deleted records
+    char *window;     //read-only mapping of the log, grown by the writer
+    size_t window_len;
+};
+
+//opens or creates the log at 'path' and indexes it; a torn record at the end is cut off
+struct bitcask *bitcask_open(const char *path);
+void bitcask_close(struct bitcask *bc);
+
+int bitcask_put(struct bitcask *bc, const char *key, const void *value, uint32_t value_len);
+int bitcask_del(struct bitcask *bc, const char *key);
+//a malloc'd copy of the value read with pread, NULL if absent
+char *bitcask_get(struct bitcask *bc, const char *key, uint32_t *value_len);
+//the value in place in the mapped log, valid until the next put, del, compact or close
+const char *bitcask_get_borrowed(struct bitcask *bc, const char *key, uint32_t *value_len);
+//rewrites the log with the live records in key order and swaps it in, garbage drops to 0
+int bitcask_compact(struct bitcask *bc);
+int bitcask_sync(struct bitcask *bc);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
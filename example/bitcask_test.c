@@ -0,0 +1,157 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "bitcask.h"
+
+#define LOG_PATH "bitcask_test.log"
+
+///////////////////////////////////////////////////////////////////////////////
+// test
+///////////////////////////////////////////////////////////////////////////////
+static char *make_key(int i){
+    static char key[32];
+    sprintf(key, "key%08d", i);
+    return key;
+}
+
+//values[i] is what key i should hold, NULL if absent
+static void check(struct bitcask *bc, char **values, int count){
+    int i = 0;
+    for(; i < count; i++){
+        uint32_t len = 0, borrowed_len = 0;
+        char *value = bitcask_get(bc, make_key(i), &len);
+        const char *borrowed = bitcask_get_borrowed(bc, make_key(i), &borrowed_len);
+        if(NULL == values[i]){
+            assert(NULL == value && NULL == borrowed);
+            continue;
+        }
+        assert(NULL != value && NULL != borrowed && len == borrowed_len);
+        assert(strlen(values[i]) == len && 0 == memcmp(values[i], value, len) && 0 == memcmp(values[i], borrowed, len));
+        free(value);
+    }
+}
+
+static off_t file_size(const char *path){
+    int fd = open(path, O_RDONLY);
+    assert(0 <= fd);
+    off_t size = lseek(fd, 0, SEEK_END);
+    close(fd);
+    return size;
+}
+
+void cover_testing(int count) __attribute__((unused));
+void cover_testing(int count) {
+    char **values = calloc(count, sizeof(*values));
+    assert(NULL != values);
+    unlink(LOG_PATH);
+    struct bitcask *bc = bitcask_open(LOG_PATH);
+    assert(NULL != bc && 0 == bc->tail);
+
+    int i = 0;
+    int64_t start = getCurrentTime();
+    for(; i < count; i++){
+        values[i] = random_str(random_range(0, 100)); //empty values too
+        assert(BITCASK_OK == bitcask_put(bc, make_key(i), values[i], strlen(values[i])));
+    }
+    printf("put time consuming:%ld count:%d\n", getCurrentTime() - start, count);
+    check(bc, values, count);
+
+    for(i = 0; i < count; i += 3){ //overwritten
+        free(values[i]);
+        values[i] = random_str(random_range(0, 100));
+        assert(BITCASK_OK == bitcask_put(bc, make_key(i), values[i], strlen(values[i])));
+    }
+    for(i = 1; i < count; i += 3){ //deleted
+        assert(BITCASK_OK == bitcask_del(bc, make_key(i)) && BITCASK_ERR == bitcask_del(bc, make_key(i)));
+        free(values[i]);
+        values[i] = NULL;
+    }
+    assert(BITCASK_ERR == bitcask_put(bc, "", "empty key", 9));
+    check(bc, values, count);
+    assert(bc->garbage > 0 && bc->sl.busy == count - (count + 1) / 3);
+    assert(BITCASK_OK == bitcask_sync(bc));
+    uint64_t tail = bc->tail, garbage = bc->garbage;
+    bitcask_close(bc);
+
+    //reopening replays the log to the same index
+    start = getCurrentTime();
+    assert(NULL != (bc = bitcask_open(LOG_PATH)));
+    printf("replay time consuming:%ld log:%lu\n", getCurrentTime() - start, (unsigned long)tail);
+    assert(tail == bc->tail && garbage == bc->garbage);
+    check(bc, values, count);
+    bitcask_close(bc);
+
+    //a torn record at the end is cut off
+    int fd = open(LOG_PATH, O_WRONLY | O_APPEND);
+    struct bitcask_record record = { 5, 100 };
+    assert(0 <= fd && sizeof(record) == write(fd, &record, sizeof(record)) && 7 == write(fd, "key-tor", 7));
+    close(fd);
+    assert(NULL != (bc = bitcask_open(LOG_PATH)) && tail == bc->tail && tail == file_size(LOG_PATH));
+    check(bc, values, count);
+
+    //compaction keeps the live records only
+    start = getCurrentTime();
+    assert(BITCASK_OK == bitcask_compact(bc));
+    printf("compact time consuming:%ld log:%lu -> %lu\n", getCurrentTime() - start, (unsigned long)tail,
+            (unsigned long)bc->tail);
+    assert(0 == bc->garbage && bc->tail < tail && bc->tail == file_size(LOG_PATH));
+    check(bc, values, count);
+    assert(BITCASK_OK == bitcask_put(bc, make_key(1), "back", 4)); //appends after the compacted records
+    free(values[1]);
+    values[1] = strdup("back");
+    check(bc, values, count);
+    tail = bc->tail;
+    bitcask_close(bc);
+    assert(NULL != (bc = bitcask_open(LOG_PATH)) && tail == bc->tail);
+    check(bc, values, count);
+
+    start = getCurrentTime();
+    for(i = 0; i < count; i++){
+        uint32_t len = 0;
+        char *value = bitcask_get(bc, make_key(i), &len);
+        free(value);
+    }
+    int64_t copy_time = getCurrentTime() - start;
+    start = getCurrentTime();
+    long sum = 0;
+    for(i = 0; i < count; i++){
+        uint32_t len = 0;
+        const char *value = bitcask_get_borrowed(bc, make_key(i), &len);
+        if(NULL != value && len > 0) sum += value[0];
+    }
+    printf("get time consuming:%ld borrowed:%ld count:%d (%ld)\n", copy_time, getCurrentTime() - start, count, sum);
+
+    bitcask_close(bc);
+    for(i = 0; i < count; i++){
+        free(values[i]);
+    }
+    free(values);
+    unlink(LOG_PATH);
+}
+
+int main(){
+    cover_testing(100000);
+    printf("over\n");
+    return 0;
+}
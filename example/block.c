@@ -0,0 +1,196 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//unrolled int skiplist against one node per key, the layout example/array.c uses
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "skiplist.h"
+#include "skiplist_block.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// one node per key
+///////////////////////////////////////////////////////////////////////////////
+struct int_item{
+    int index;
+    void *value;
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+static int int_item_cmp(void *k1, void *k2){
+    struct int_item *i = skiplist_entry(k1, struct int_item, node), *j = skiplist_entry(k2, struct int_item, node);
+    return (i->index > j->index) - (i->index < j->index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// checks
+///////////////////////////////////////////////////////////////////////////////
+static void check_block(struct bskiplist *sl){
+    int i = 0, busy = 0, nodes = 0, last = 0, first = 1;
+    struct bskiplist_node *pos = NULL;
+    BSKIPLIST_FOREACH(sl, pos){
+        assert(0 < pos->count && pos->count <= BSKIPLIST_BLOCK);
+        for(i = 0; i < BSKIPLIST_BLOCK; i++){
+            if(i < pos->count){
+                assert(first || last < pos->keys[i]);
+                last = pos->keys[i];
+                first = 0;
+            }else{
+                assert(INT_MAX == pos->keys[i]);
+            }
+        }
+        busy += pos->count;
+        nodes += 1;
+    }
+    assert(busy == sl->busy && nodes == sl->nodes);
+    for(i = 0; i < sl->level; i++){ //every link caches the first key of its target
+        struct bskiplist_node *p = sl->header;
+        for(; NULL != p->link[i].next; p = p->link[i].next){
+            assert(p->link[i].key == p->link[i].next->keys[0]);
+        }
+    }
+    assert(1 == sl->level || NULL != sl->header->link[sl->level - 1].next);
+}
+
+void cover_testing(int key_range, int count) __attribute__((unused));
+void cover_testing(int key_range, int count){
+    struct bskiplist sl;
+    bskiplist_init(&sl);
+    char *present = calloc(key_range, 1);
+    assert(NULL != present);
+    int i = 0;
+    for(; i < count; i++){
+        int key = random_range(0, key_range - 1);
+        void *value = NULL;
+        if(random() % 3){
+            assert(SKIPLIST_OK == bskiplist_put(&sl, key, (void *)(intptr_t)(key + i)));
+            assert(SKIPLIST_OK == bskiplist_get(&sl, key, &value) && (intptr_t)(key + i) == (intptr_t)value);
+            present[key] = 1;
+        }else{
+            int res = bskiplist_del(&sl, key, &value);
+            assert((SKIPLIST_OK == res) == present[key]);
+            assert(SKIPLIST_ERR == bskiplist_get(&sl, key, &value));
+            present[key] = 0;
+        }
+        if(0 == i % 1000) check_block(&sl);
+    }
+    check_block(&sl);
+    for(i = 0; i < key_range; i++){
+        void *value = NULL;
+        assert((SKIPLIST_OK == bskiplist_get(&sl, i, &value)) == present[i]);
+    }
+    void *value = NULL;
+    assert(SKIPLIST_OK == bskiplist_put(&sl, INT_MAX, NULL) && SKIPLIST_OK == bskiplist_get(&sl, INT_MAX, &value));
+    assert(SKIPLIST_OK == bskiplist_put(&sl, INT_MIN, NULL) && SKIPLIST_OK == bskiplist_get(&sl, INT_MIN, &value));
+    check_block(&sl);
+    bskiplist_destroy(&sl);
+    assert(0 == sl.busy && 0 == sl.nodes);
+    free(present);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// benchmark
+///////////////////////////////////////////////////////////////////////////////
+static void bench(int n, int sequential){
+    int *keys = malloc(sizeof(*keys) * n), i = 0;
+    assert(NULL != keys);
+    for(; i < n; i++){
+        keys[i] = sequential ? i : (int)random();
+    }
+
+    struct skiplist sl;
+    skiplist_init(&sl, int_item_cmp);
+    size_t list_bytes = 0;
+    int64_t start = getCurrentTimeNs();
+    for(i = 0; i < n; i++){
+        struct int_item *item = SKIPLIST_NODE_ALLOC(&sl, struct int_item, node);
+        assert(NULL != item);
+        item->index = keys[i];
+        item->value = item;
+        if(SKIPLIST_OK == skiplist_put(&sl, &item->node)){
+            list_bytes += sizeof(*item) + item->node.level * sizeof(struct skiplist_link);
+        }else{
+            free(item);
+        }
+    }
+    int64_t list_put = getCurrentTimeNs() - start;
+
+    struct bskiplist bsl;
+    bskiplist_init(&bsl);
+    start = getCurrentTimeNs();
+    for(i = 0; i < n; i++){
+        assert(SKIPLIST_OK == bskiplist_put(&bsl, keys[i], &keys[i]));
+    }
+    int64_t block_put = getCurrentTimeNs() - start;
+    assert(sl.busy == bsl.busy);
+    size_t block_bytes = 0;
+    struct bskiplist_node *pos = NULL;
+    BSKIPLIST_FOREACH(&bsl, pos){
+        block_bytes += sizeof(*pos) + pos->level * sizeof(struct bskiplist_link);
+    }
+
+    long found = 0;
+    start = getCurrentTimeNs();
+    for(i = 0; i < n; i++){
+        struct int_item probe = { .index = keys[(i * 7919L) % n] };
+        found += NULL != skiplist_get(&sl, &probe.node);
+    }
+    int64_t list_get = getCurrentTimeNs() - start;
+    start = getCurrentTimeNs();
+    for(i = 0; i < n; i++){
+        void *value = NULL;
+        found -= SKIPLIST_OK == bskiplist_get(&bsl, keys[(i * 7919L) % n], &value);
+    }
+    int64_t block_get = getCurrentTimeNs() - start;
+    assert(0 == found);
+
+    printf("%-10s %9d %10.1f %10.1f %10.1f %10.1f %8.1f %8.1f\n", sequential ? "sequential" : "random", n,
+            (double)list_put / n, (double)block_put / n, (double)list_get / n, (double)block_get / n,
+            (double)list_bytes / sl.busy, (double)block_bytes / bsl.busy);
+
+    struct skiplist_node *node, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT(&sl, node, iter){
+        free(skiplist_entry(node, struct int_item, node));
+    }
+    bskiplist_destroy(&bsl);
+    free(keys);
+}
+
+int main(int argc, char **argv){
+    int max_items = argc > 1 ? atoi(argv[1]) : 1000000;
+    cover_testing(5000, 200000);
+
+#if defined(__AVX2__)
+    printf("block:%d search:avx2\n", BSKIPLIST_BLOCK);
+#elif defined(__SSE2__)
+    printf("block:%d search:sse2\n", BSKIPLIST_BLOCK);
+#else
+    printf("block:%d search:scalar\n", BSKIPLIST_BLOCK);
+#endif
+    printf("%-10s %9s %10s %10s %10s %10s %8s %8s\n", "keys", "items", "put ns", "bput ns", "get ns", "bget ns", "B/key", "bB/key");
+    int n = 10000;
+    for(; n <= max_items; n *= 10){
+        bench(n, 0);
+        bench(n, 1);
+    }
+
+    printf("over\n");
+    return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "skiplist.h"
+#include "skiplist_lockfree.h"
+#include "map.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// lock-free int map
+///////////////////////////////////////////////////////////////////////////////
+struct lf_item{
+    int key;
+    int value;
+    struct lfskiplist_node node; //must be last, the tower follows it
+};
+
+static int lf_item_cmp(void *k1, void *k2){
+    struct lf_item *i = skiplist_entry(k1, struct lf_item, node), *j = skiplist_entry(k2, struct lf_item, node);
+    return (i->key > j->key) - (i->key < j->key);
+}
+
+static void lf_item_free(struct skiplist_epoch_entry *entry){
+    free(skiplist_entry(entry, struct lf_item, node.retire));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mutex baseline: the single-threaded skiplist behind one global lock
+///////////////////////////////////////////////////////////////////////////////
+struct mx_item{
+    int key;
+    int value;
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+static int mx_item_cmp(void *k1, void *k2){
+    struct mx_item *i = skiplist_entry(k1, struct mx_item, node), *j = skiplist_entry(k2, struct mx_item, node);
+    return (i->key > j->key) - (i->key < j->key);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// benchmark
+///////////////////////////////////////////////////////////////////////////////
+#define BENCH_MAX_THREADS 64
+
+struct bench{
+    int lockfree;
+    int key_range;
+    int read_percent;
+    int stop;
+    struct lfskiplist lf;
+    struct skiplist_epoch epoch;
+    struct skiplist_epoch_thread records[BENCH_MAX_THREADS + 1];
+    struct skiplist mx;
+    pthread_mutex_t lock;
+};
+
+struct worker{
+    struct bench *b;
+    int id;
+    uint64_t seed;
+    long ops;
+    pthread_t tid;
+};
+
+static inline uint64_t xorshift64(uint64_t *s){
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+static void lf_op(struct bench *b, struct skiplist_epoch_thread *thr, int op, int key){
+    struct lf_item probe = { .key = key };
+    skiplist_epoch_enter(&b->epoch, thr);
+    if(op < b->read_percent){
+        struct lfskiplist_node *node = lfskiplist_get(&b->lf, &probe.node);
+        if(NULL != node) assert(key == skiplist_entry(node, struct lf_item, node)->value);
+    }else if(op & 1){
+        struct lf_item *item = LFSKIPLIST_NODE_ALLOC(&b->lf, struct lf_item, node);
+        assert(NULL != item);
+        item->key = item->value = key;
+        if(SKIPLIST_OK != lfskiplist_put(&b->lf, thr, &item->node)){
+            free(item); //never published
+        }
+    }else{
+        lfskiplist_del(&b->lf, thr, &probe.node);
+    }
+    skiplist_epoch_exit(thr);
+}
+
+static void mx_op(struct bench *b, int op, int key){
+    struct mx_item probe = { .key = key };
+    if(op < b->read_percent){
+        pthread_mutex_lock(&b->lock);
+        struct skiplist_node *node = skiplist_get(&b->mx, &probe.node);
+        if(NULL != node) assert(key == skiplist_entry(node, struct mx_item, node)->value);
+        pthread_mutex_unlock(&b->lock);
+    }else if(op & 1){
+        pthread_mutex_lock(&b->lock);
+        struct mx_item *item = SKIPLIST_NODE_ALLOC(&b->mx, struct mx_item, node);
+        assert(NULL != item);
+        item->key = item->value = key;
+        if(SKIPLIST_OK != skiplist_put(&b->mx, &item->node)){
+            free(item);
+        }
+        pthread_mutex_unlock(&b->lock);
+    }else{
+        pthread_mutex_lock(&b->lock);
+        struct skiplist_node *node = skiplist_remove(&b->mx, &probe.node);
+        pthread_mutex_unlock(&b->lock);
+        if(NULL != node) free(skiplist_entry(node, struct mx_item, node));
+    }
+}
+
+static void *worker_run(void *arg){
+    struct worker *w = arg;
+    struct bench *b = w->b;
+    struct skiplist_epoch_thread *thr = &b->records[w->id];
+    while(!__atomic_load_n(&b->stop, __ATOMIC_RELAXED)){
+        int i = 0;
+        for(; i < 256; i++){
+            uint64_t r = xorshift64(&w->seed);
+            int key = (int)(r % b->key_range), op = (int)((r >> 32) % 100);
+            if(b->lockfree) lf_op(b, thr, op, key);
+            else mx_op(b, op, key);
+        }
+        w->ops += 256;
+    }
+    return NULL;
+}
+
+static void bench_fill(struct bench *b){
+    int key = 0;
+    for(; key < b->key_range; key += 2){ //half full, so puts and dels both hit
+        if(b->lockfree) lf_op(b, &b->records[BENCH_MAX_THREADS], 100 + 1, key);
+        else mx_op(b, 100 + 1, key);
+    }
+}
+
+static void bench_check(struct bench *b){
+    int count = 0, last = -1;
+    if(b->lockfree){
+        struct lfskiplist_node *pos = LFSKIPLIST_UNMARK(b->lf.header->next[0]);
+        for(; NULL != pos; pos = LFSKIPLIST_UNMARK(pos->next[0])){
+            struct lf_item *item = skiplist_entry(pos, struct lf_item, node);
+            assert(!LFSKIPLIST_MARKED(pos->next[0]) && last < item->key);
+            last = item->key;
+            count += 1;
+        }
+        assert(count == b->lf.busy);
+    }else{
+        struct skiplist_node *pos, *iter = NULL;
+        SKIPLIST_FOREACH_NEXT(&b->mx, pos, iter){
+            struct mx_item *item = skiplist_entry(pos, struct mx_item, node);
+            assert(last < item->key);
+            last = item->key;
+            count += 1;
+        }
+        assert(count == b->mx.busy);
+    }
+}
+
+static void bench_clear(struct bench *b){
+    if(b->lockfree){
+        lfskiplist_destroy(&b->lf);
+        skiplist_epoch_destroy(&b->epoch);
+    }else{
+        struct skiplist_node *pos, *iter = NULL;
+        SKIPLIST_FOREACH_NEXT(&b->mx, pos, iter){
+            free(skiplist_entry(pos, struct mx_item, node));
+        }
+        pthread_mutex_destroy(&b->lock);
+    }
+}
+
+static double bench_run(int lockfree, int threads, int key_range, int read_percent, int millis){
+    static struct bench b;
+    struct worker workers[BENCH_MAX_THREADS];
+    memset(&b, 0, sizeof(b));
+    b.lockfree = lockfree;
+    b.key_range = key_range;
+    b.read_percent = read_percent;
+    skiplist_epoch_init(&b.epoch);
+    lfskiplist_init(&b.lf, lf_item_cmp, lf_item_free, &b.epoch);
+    skiplist_init(&b.mx, mx_item_cmp);
+    pthread_mutex_init(&b.lock, NULL);
+    int i = 0;
+    for(; i <= BENCH_MAX_THREADS; i++){
+        skiplist_epoch_register(&b.epoch, &b.records[i]);
+    }
+    bench_fill(&b);
+
+    int64_t start = getCurrentTime();
+    for(i = 0; i < threads; i++){
+        workers[i] = (struct worker){ .b = &b, .id = i, .seed = 0x9E3779B97F4A7C15ULL * (i + 1), .ops = 0 };
+        assert(0 == pthread_create(&workers[i].tid, NULL, worker_run, &workers[i]));
+    }
+    usleep(millis * 1000);
+    __atomic_store_n(&b.stop, 1, __ATOMIC_RELAXED);
+    long ops = 0;
+    for(i = 0; i < threads; i++){
+        pthread_join(workers[i].tid, NULL);
+        ops += workers[i].ops;
+    }
+    int64_t elapsed = getCurrentTime() - start;
+
+    bench_check(&b);
+    bench_clear(&b);
+    return (double)ops / (elapsed > 0 ? elapsed : 1) / 1000.0; //million ops per second
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// lock-free map
+///////////////////////////////////////////////////////////////////////////////
+struct lf_map_worker{
+    struct lf_map *m;
+    struct skiplist_epoch_thread thr;
+    int keys;
+    int ops;
+    uint64_t seed;
+    long hits;
+    pthread_t tid;
+};
+
+//every value is its key, so a get that reads a pair freed too early trips the compare (or ASan)
+static void *lf_map_run(void *arg){
+    struct lf_map_worker *w = arg;
+    char key[16];
+    int i = 0;
+    for(; i < w->ops; i++){
+        uint64_t r = xorshift64(&w->seed);
+        int op = (int)((r >> 32) % 4);
+        sprintf(key, "k%07d", (int)(r % w->keys));
+        lf_map_enter(w->m, &w->thr);
+        if(0 == op){
+            lf_map_put(w->m, &w->thr, key, key);
+        }else if(1 == op){
+            lf_map_del(w->m, &w->thr, key);
+        }else{
+            const char *value = lf_map_get(w->m, key);
+            if(NULL != value){
+                assert(0 == strcmp(key, value));
+                w->hits += 1;
+            }
+        }
+        lf_map_exit(&w->thr);
+    }
+    return NULL;
+}
+
+void lf_map_testing(int threads, int keys, int ops) __attribute__((unused));
+void lf_map_testing(int threads, int keys, int ops) {
+    struct lf_map *m = lf_map_create();
+    struct lf_map_worker *workers = calloc(threads + 1, sizeof(*workers));
+    assert(NULL != m && NULL != workers);
+    int i = 0;
+    for(; i <= threads; i++){
+        workers[i] = (struct lf_map_worker){ .m = m, .keys = keys, .ops = ops, .seed = 0x9E3779B97F4A7C15ULL * (i + 1) };
+        lf_map_register(m, &workers[i].thr);
+    }
+
+    struct skiplist_epoch_thread *thr = &workers[threads].thr; //this thread's own record
+    lf_map_enter(m, thr);
+    assert(MAP_OK == lf_map_put(m, thr, "a", "1") && MAP_ERR == lf_map_put(m, thr, "a", "2"));
+    assert(MAP_ERR == lf_map_put(m, thr, "b", NULL) && NULL == lf_map_get(m, "b"));
+    assert(0 == strcmp("1", lf_map_get(m, "a")) && 1 == lf_map_busy(m));
+    assert(MAP_OK == lf_map_del(m, thr, "a") && MAP_ERR == lf_map_del(m, thr, "a") && NULL == lf_map_get(m, "a"));
+    lf_map_exit(thr);
+
+    int64_t start = getCurrentTime();
+    for(i = 0; i < threads; i++){
+        assert(0 == pthread_create(&workers[i].tid, NULL, lf_map_run, &workers[i]));
+    }
+    long hits = 0;
+    for(i = 0; i < threads; i++){
+        pthread_join(workers[i].tid, NULL);
+        hits += workers[i].hits;
+    }
+    int64_t elapsed = getCurrentTime() - start;
+
+    int count = 0;
+    const char *last = "";
+    struct lfskiplist_node *pos = LFSKIPLIST_UNMARK(m->sl.header->next[0]);
+    for(; NULL != pos; pos = LFSKIPLIST_UNMARK(pos->next[0])){ //quiescent: ordered, no marks, values intact
+        struct lf_map_pair *pair = skiplist_entry(pos, struct lf_map_pair, node);
+        assert(!LFSKIPLIST_MARKED(pos->next[0]) && 0 < strcmp(pair->key, last) && 0 == strcmp(pair->key, pair->value));
+        last = pair->key;
+        count += 1;
+    }
+    assert(count == lf_map_busy(m));
+    printf("lf map time consuming:%ld threads:%d ops:%d hits:%ld busy:%d\n", elapsed, threads, threads * ops, hits, count);
+    lf_map_free(m);
+    free(workers);
+}
+
+int main(int argc, char **argv){
+    int max_threads = argc > 1 ? atoi(argv[1]) : BENCH_MAX_THREADS;
+    int read_percent = argc > 2 ? atoi(argv[2]) : 90;
+    int key_range = argc > 3 ? atoi(argv[3]) : 1000000;
+    int millis = argc > 4 ? atoi(argv[4]) : 500;
+    if(max_threads < 1 || max_threads > BENCH_MAX_THREADS) max_threads = BENCH_MAX_THREADS;
+
+    printf("reads:%d%% keys:%d cpus:%ld\n", read_percent, key_range, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %16s %16s\n", "threads", "lockfree Mops/s", "mutex Mops/s");
+    int threads = 1;
+    for(; threads <= max_threads; threads *= 2){
+        double lf = bench_run(1, threads, key_range, read_percent, millis);
+        double mx = bench_run(0, threads, key_range, read_percent, millis);
+        printf("%8d %16.2f %16.2f\n", threads, lf, mx);
+    }
+
+    lf_map_testing(max_threads < 8 ? max_threads : 8, 10000, 100000);
+    printf("over\n");
+    return 0;
+}
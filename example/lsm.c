@@ -0,0 +1,753 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "lsm.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// table
+///////////////////////////////////////////////////////////////////////////////
+//a table file is its data blocks, the block index, the bloom filter and the footer. A record is a
+//struct lsm_record then the key and the value with their terminators (value_size 0 for a delete), an
+//index entry is the key size, the last key of the block, its uint64 offset and its uint32 size
+#define LSM_TABLE_MAGIC 0x3130424154534D4CULL //"LMSTAB01" read little endian
+
+enum{ LSM_ABSENT, LSM_FOUND, LSM_DELETED };
+
+struct lsm_record{
+    uint32_t key_size;
+    uint32_t value_size;
+};
+
+struct lsm_footer{
+    uint64_t index_pos;
+    uint64_t index_size;
+    uint64_t bloom_pos;
+    uint64_t bloom_size;
+    uint64_t count;
+    uint32_t bloom_k;
+    uint32_t blocks;
+    uint64_t magic;
+};
+
+struct lsm_table{
+    int id;
+    int fd;
+    int refs;
+    uint32_t blocks;
+    char *index;         //loaded whole, last_keys point into it
+    char **last_keys;
+    uint64_t *block_pos;
+    uint32_t *block_size;
+    uint8_t *bloom;
+    uint64_t bloom_bits;
+    uint32_t bloom_k;
+    struct lsm_table *next;
+};
+
+//a position in a table, 'key' and 'value' are the current record and live in 'data', the current block
+struct lsm_cursor{
+    struct lsm_table *table;
+    uint32_t block;
+    char *data;
+    uint32_t size;
+    uint32_t off;
+    const char *key;
+    const char *value;
+};
+
+struct lsm_buf{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static int lsm_buf_add(struct lsm_buf *buf, const void *data, size_t len){
+    if(0 == len) return LSM_OK;
+    if(buf->len + len > buf->cap){
+        size_t cap = buf->cap > 0 ? buf->cap : LSM_BLOCK_SIZE * 2;
+        while(cap < buf->len + len) cap *= 2;
+        char *res = realloc(buf->data, cap);
+        if(NULL == res) return LSM_ERR;
+        buf->data = res;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return LSM_OK;
+}
+
+//FNV-1a, the two halves seed the bloom probes
+static uint64_t lsm_hash(const char *key){
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for(; '\0' != *key; key++){
+        h = (h ^ (unsigned char)*key) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static void lsm_bloom_add(uint8_t *bloom, uint64_t bits, uint32_t k, const char *key){
+    uint64_t h = lsm_hash(key), h1 = (uint32_t)h, h2 = (h >> 32) | 1;
+    uint32_t i = 0;
+    for(; i < k; i++){
+        uint64_t bit = (h1 + i * h2) % bits;
+        bloom[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+static int lsm_bloom_test(struct lsm_table *t, const char *key){
+    uint64_t h = lsm_hash(key), h1 = (uint32_t)h, h2 = (h >> 32) | 1;
+    uint32_t i = 0;
+    for(; i < t->bloom_k; i++){
+        uint64_t bit = (h1 + i * h2) % t->bloom_bits;
+        if(0 == (t->bloom[bit >> 3] & (1 << (bit & 7)))) return 0;
+    }
+    return 1;
+}
+
+static int lsm_block_write(FILE *file, struct lsm_buf *block, struct lsm_buf *index, const char *last_key, uint64_t *pos){
+    uint32_t key_size = strlen(last_key) + 1, size = block->len;
+    if(1 != fwrite(block->data, block->len, 1, file)) return LSM_ERR;
+    if(LSM_OK != lsm_buf_add(index, &key_size, sizeof(key_size)) || LSM_OK != lsm_buf_add(index, last_key, key_size) ||
+            LSM_OK != lsm_buf_add(index, pos, sizeof(*pos)) || LSM_OK != lsm_buf_add(index, &size, sizeof(size))){
+        return LSM_ERR;
+    }
+    *pos += block->len;
+    block->len = 0;
+    return LSM_OK;
+}
+
+//streams 'm' in key order into a table at 'path', written aside and renamed in place once synced
+static int lsm_table_write(const char *path, struct map *m){
+    struct lsm_buf block = { 0 }, index = { 0 };
+    struct lsm_footer footer = { 0 };
+    uint64_t pos = 0, count = ((struct skiplist *)m)->busy;
+    uint64_t bits = count * LSM_BLOOM_BITS > 64 ? (count * LSM_BLOOM_BITS + 7) / 8 * 8 : 64; //whole bytes, readers use bloom_size * 8
+    uint8_t *bloom = calloc(bits / 8, 1);
+    char *tmp = malloc(strlen(path) + 5);
+    const char *last_key = NULL;
+    FILE *file = NULL;
+    if(NULL == bloom || NULL == tmp) goto err;
+    sprintf(tmp, "%s.tmp", path);
+    if(NULL == (file = fopen(tmp, "wb"))) goto err;
+    footer.bloom_k = (uint32_t)(LSM_BLOOM_BITS * 0.69 + 0.5); //ln 2 * bits per key
+    if(footer.bloom_k < 1) footer.bloom_k = 1;
+
+    struct skiplist_node *node, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, node, iter){
+        struct map_pair *pair = skiplist_entry(node, struct map_pair, node);
+        struct lsm_record record = { strlen(pair->key) + 1, NULL != pair->value ? strlen(pair->value) + 1 : 0 };
+        if(LSM_OK != lsm_buf_add(&block, &record, sizeof(record)) || LSM_OK != lsm_buf_add(&block, pair->key, record.key_size) ||
+                LSM_OK != lsm_buf_add(&block, pair->value, record.value_size)){
+            goto err;
+        }
+        lsm_bloom_add(bloom, bits, footer.bloom_k, pair->key);
+        last_key = pair->key;
+        if(block.len >= LSM_BLOCK_SIZE){
+            if(LSM_OK != lsm_block_write(file, &block, &index, last_key, &pos)) goto err;
+            footer.blocks += 1;
+        }
+    }
+    if(block.len > 0){
+        if(LSM_OK != lsm_block_write(file, &block, &index, last_key, &pos)) goto err;
+        footer.blocks += 1;
+    }
+    footer.index_pos = pos;
+    footer.index_size = index.len;
+    footer.bloom_pos = pos + index.len;
+    footer.bloom_size = bits / 8;
+    footer.count = count;
+    footer.magic = LSM_TABLE_MAGIC;
+    if((index.len > 0 && 1 != fwrite(index.data, index.len, 1, file)) || 1 != fwrite(bloom, footer.bloom_size, 1, file) ||
+            1 != fwrite(&footer, sizeof(footer), 1, file) || 0 != fflush(file) || 0 != fsync(fileno(file))){
+        goto err;
+    }
+    fclose(file);
+    file = NULL;
+    if(0 != rename(tmp, path)){
+        unlink(tmp);
+        goto err;
+    }
+    free(block.data);
+    free(index.data);
+    free(bloom);
+    free(tmp);
+    return LSM_OK;
+
+err:
+    if(NULL != file){
+        fclose(file);
+        unlink(tmp);
+    }
+    free(block.data);
+    free(index.data);
+    free(bloom);
+    free(tmp);
+    return LSM_ERR;
+}
+
+static void lsm_table_free(struct lsm_table *t){
+    if(NULL == t) return;
+    if(0 <= t->fd) close(t->fd);
+    free(t->index);
+    free(t->last_keys);
+    free(t->block_pos);
+    free(t->block_size);
+    free(t->bloom);
+    free(t);
+}
+
+//reads the footer, the index and the bloom filter, the data blocks stay on disk
+static struct lsm_table *lsm_table_open(const char *path, int id){
+    struct lsm_footer footer;
+    struct stat st;
+    struct lsm_table *t = calloc(1, sizeof(*t));
+    if(NULL == t) return NULL;
+    t->id = id;
+    t->refs = 1;
+    if(0 > (t->fd = open(path, O_RDONLY))) goto err;
+    if(0 != fstat(t->fd, &st) || st.st_size < (off_t)sizeof(footer)) goto err;
+    if(0 != read_from_file(t->fd, &footer, sizeof(footer), st.st_size - sizeof(footer))) goto err;
+    if(LSM_TABLE_MAGIC != footer.magic || footer.index_pos + footer.index_size != footer.bloom_pos ||
+            footer.bloom_pos + footer.bloom_size + sizeof(footer) != (uint64_t)st.st_size || 0 == footer.bloom_size){
+        goto err;
+    }
+    t->blocks = footer.blocks;
+    t->bloom_k = footer.bloom_k;
+    t->bloom_bits = footer.bloom_size * 8;
+    if(NULL == (t->index = malloc(footer.index_size + 1)) || NULL == (t->bloom = malloc(footer.bloom_size))) goto err;
+    if(0 != read_from_file(t->fd, t->index, footer.index_size, footer.index_pos) ||
+            0 != read_from_file(t->fd, t->bloom, footer.bloom_size, footer.bloom_pos)){
+        goto err;
+    }
+    t->last_keys = malloc(sizeof(*t->last_keys) * (t->blocks + 1));
+    t->block_pos = malloc(sizeof(*t->block_pos) * (t->blocks + 1));
+    t->block_size = malloc(sizeof(*t->block_size) * (t->blocks + 1));
+    if(NULL == t->last_keys || NULL == t->block_pos || NULL == t->block_size) goto err;
+    char *p = t->index, *end = t->index + footer.index_size;
+    uint32_t b = 0, key_size = 0;
+    for(; b < t->blocks; b++){
+        if(end - p < (long)sizeof(key_size)) goto err;
+        memcpy(&key_size, p, sizeof(key_size));
+        if(0 == key_size || end - p < (long)(sizeof(key_size) + key_size + 12) || '\0' != p[sizeof(key_size) + key_size - 1]) goto err;
+        t->last_keys[b] = p + sizeof(key_size);
+        p += sizeof(key_size) + key_size;
+        memcpy(&t->block_pos[b], p, sizeof(uint64_t));
+        memcpy(&t->block_size[b], p + sizeof(uint64_t), sizeof(uint32_t));
+        p += 12;
+    }
+    return t;
+
+err:
+    lsm_table_free(t);
+    return NULL;
+}
+
+//first block whose last key is not below 'key', 'blocks' if none
+static uint32_t lsm_table_block(struct lsm_table *t, const char *key){
+    uint32_t lo = 0, hi = t->blocks;
+    while(lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        if(strcmp(t->last_keys[mid], key) < 0){
+            lo = mid + 1;
+        }else{
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+//an unreadable block ends the cursor
+static void lsm_cursor_load(struct lsm_cursor *c, uint32_t block){
+    free(c->data);
+    c->data = NULL;
+    c->block = block;
+    c->off = 0;
+    c->size = 0;
+    if(block < c->table->blocks){
+        c->size = c->table->block_size[block];
+        c->data = read_value_from_file(c->table->fd, c->size, c->table->block_pos[block]);
+    }
+}
+
+static void lsm_cursor_step(struct lsm_cursor *c){
+    struct lsm_record record;
+    for(;;){
+        if(NULL == c->data){
+            c->key = c->value = NULL;
+            return;
+        }
+        if(c->off + sizeof(record) <= c->size) break;
+        lsm_cursor_load(c, c->block + 1);
+    }
+    memcpy(&record, c->data + c->off, sizeof(record));
+    c->key = c->data + c->off + sizeof(record);
+    c->value = record.value_size > 0 ? c->key + record.key_size : NULL;
+    c->off += sizeof(record) + record.key_size + record.value_size;
+}
+
+//the cursor stands on the first record not below 'key', which may be NULL
+static void lsm_cursor_seek(struct lsm_cursor *c, struct lsm_table *t, const char *key){
+    c->table = t;
+    c->data = NULL;
+    lsm_cursor_load(c, NULL != key ? lsm_table_block(t, key) : 0);
+    lsm_cursor_step(c);
+    while(NULL != key && NULL != c->key && strcmp(c->key, key) < 0){
+        lsm_cursor_step(c);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// engine
+///////////////////////////////////////////////////////////////////////////////
+static struct lsm_memtable *lsm_memtable_create(){
+    struct lsm_memtable *mt = calloc(1, sizeof(*mt));
+    if(NULL == mt) return NULL;
+    if(NULL == (mt->map = map_create_arena(0))){ //a flushed memtable goes in one free
+        free(mt);
+        return NULL;
+    }
+    mt->refs = 1;
+    return mt;
+}
+
+//under db->lock, as every ref change
+static void lsm_memtable_unref(struct lsm_memtable *mt){
+    if(0 == --mt->refs){
+        map_free(mt->map);
+        free(mt);
+    }
+}
+
+static void lsm_table_unref(struct lsm_table *t){
+    if(0 == --t->refs){
+        lsm_table_free(t);
+    }
+}
+
+static char *lsm_table_path(struct lsm *db, int id){
+    char *path = malloc(strlen(db->dir) + 16);
+    if(NULL != path) sprintf(path, "%s/%06d.sst", db->dir, id);
+    return path;
+}
+
+//under db->lock
+static int lsm_freeze(struct lsm *db){
+    struct lsm_memtable *mt = lsm_memtable_create();
+    if(NULL == mt) return LSM_ERR;
+    db->active->next = db->frozen;
+    db->frozen = db->active;
+    db->frozen_count += 1;
+    db->active = mt;
+    pthread_cond_broadcast(&db->cond);
+    return LSM_OK;
+}
+
+static void *lsm_flush_thread(void *arg){
+    struct lsm *db = arg;
+    pthread_mutex_lock(&db->lock);
+    for(;;){
+        while(!db->stop && (NULL == db->frozen || db->flush_error)){
+            pthread_cond_wait(&db->cond, &db->lock);
+        }
+        if(NULL == db->frozen || db->flush_error) break;
+        struct lsm_memtable *mt = db->frozen, **prev = NULL;
+        while(NULL != mt->next){ //the oldest, tables must be written in age order
+            mt = mt->next;
+        }
+        int id = db->next_id++;
+        pthread_mutex_unlock(&db->lock);
+
+        struct lsm_table *t = NULL;
+        char *path = lsm_table_path(db, id);
+        if(NULL != path && LSM_OK == lsm_table_write(path, mt->map)){ //frozen maps are never written to
+            t = lsm_table_open(path, id);
+        }
+        free(path);
+
+        pthread_mutex_lock(&db->lock);
+        if(NULL == t){
+            db->flush_error = 1; //the memtable stays readable, writers get errors from now on
+        }else{
+            t->next = db->tables; //newer than every table so far
+            db->tables = t;
+            for(prev = &db->frozen; *prev != mt; prev = &(*prev)->next);
+            *prev = NULL;
+            db->frozen_count -= 1;
+            db->flushes += 1;
+            lsm_memtable_unref(mt);
+        }
+        pthread_cond_broadcast(&db->cond);
+    }
+    pthread_mutex_unlock(&db->lock);
+    return NULL;
+}
+
+static int lsm_id_cmp(const void *a, const void *b){
+    return *(const int *)a - *(const int *)b;
+}
+
+//tables named by 6 digit ids, oldest first
+static int lsm_load_tables(struct lsm *db){
+    DIR *dir = opendir(db->dir);
+    struct dirent *entry = NULL;
+    int *ids = NULL, count = 0, cap = 0, i = 0, res = LSM_OK;
+    if(NULL == dir) return LSM_ERR;
+    while(NULL != (entry = readdir(dir))){
+        const char *name = entry->d_name;
+        if(10 != strlen(name) || 0 != strcmp(name + 6, ".sst") || 6 != strspn(name, "0123456789")) continue;
+        if(count == cap){
+            int *grown = realloc(ids, sizeof(*ids) * (cap = cap > 0 ? cap * 2 : 16));
+            if(NULL == grown) goto err;
+            ids = grown;
+        }
+        ids[count++] = atoi(name);
+    }
+    if(count > 1) qsort(ids, count, sizeof(*ids), lsm_id_cmp);
+    for(; i < count; i++){
+        char *path = lsm_table_path(db, ids[i]);
+        struct lsm_table *t = NULL != path ? lsm_table_open(path, ids[i]) : NULL;
+        free(path);
+        if(NULL == t) goto err;
+        t->next = db->tables;
+        db->tables = t;
+        db->next_id = ids[i] + 1;
+    }
+    goto out;
+
+err:
+    res = LSM_ERR;
+out:
+    closedir(dir);
+    free(ids);
+    return res;
+}
+
+static void lsm_free(struct lsm *db){
+    while(NULL != db->frozen){
+        struct lsm_memtable *mt = db->frozen;
+        db->frozen = mt->next;
+        lsm_memtable_unref(mt);
+    }
+    while(NULL != db->tables){
+        struct lsm_table *t = db->tables;
+        db->tables = t->next;
+        lsm_table_unref(t);
+    }
+    if(NULL != db->active) lsm_memtable_unref(db->active);
+    pthread_mutex_destroy(&db->lock);
+    pthread_cond_destroy(&db->cond);
+    free(db->dir);
+    free(db);
+}
+
+struct lsm *lsm_open(const char *dir, size_t memtable_limit){
+    struct lsm *db = calloc(1, sizeof(*db));
+    if(NULL == db) return NULL;
+    pthread_mutex_init(&db->lock, NULL);
+    pthread_cond_init(&db->cond, NULL);
+    db->memtable_limit = memtable_limit;
+    if(NULL == (db->dir = strdup(dir)) || NULL == (db->active = lsm_memtable_create())) goto err;
+    if(LSM_OK != lsm_load_tables(db)) goto err;
+    if(0 != pthread_create(&db->flusher, NULL, lsm_flush_thread, db)) goto err;
+    return db;
+
+err:
+    lsm_free(db);
+    return NULL;
+}
+
+int lsm_close(struct lsm *db){
+    int res = lsm_flush(db);
+    pthread_mutex_lock(&db->lock);
+    db->stop = 1;
+    pthread_cond_broadcast(&db->cond);
+    pthread_mutex_unlock(&db->lock);
+    pthread_join(db->flusher, NULL);
+    lsm_free(db);
+    return res;
+}
+
+int lsm_flush(struct lsm *db){
+    int res = LSM_OK;
+    pthread_mutex_lock(&db->lock);
+    if(((struct skiplist *)db->active->map)->busy > 0){
+        res = lsm_freeze(db);
+    }
+    while(LSM_OK == res && NULL != db->frozen && !db->flush_error){
+        pthread_cond_wait(&db->cond, &db->lock);
+    }
+    if(db->flush_error) res = LSM_ERR;
+    pthread_mutex_unlock(&db->lock);
+    return res;
+}
+
+//tables compare whole keys, memtables only the first MAP_MAX_KEY_LEN bytes: longer keys are refused
+//everywhere so that an answer never changes with a flush
+static int lsm_key_fits(const char *key){
+    return strnlen(key, MAP_MAX_KEY_LEN + 1) <= MAP_MAX_KEY_LEN;
+}
+
+//a NULL value is a delete
+static int lsm_write(struct lsm *db, const char *key, const char *value){
+    if(NULL == key || '\0' == key[0] || !lsm_key_fits(key)) return LSM_ERR;
+    size_t key_len = strlen(key);
+    struct lsm_memtable *mt = db->active; //only this thread touches the active memtable
+    struct map_pair *pair = map_pair_create_inline(mt->map, key, value);
+    if(NULL == pair) return LSM_ERR;
+    if(MAP_OK != map_set(mt->map, pair)){
+        map_pair_release(mt->map, pair);
+        return LSM_ERR;
+    }
+    mt->bytes += sizeof(*pair) + pair->node.level * sizeof(struct skiplist_link) + key_len + 1 + (NULL != value ? strlen(value) + 1 : 0);
+    if(mt->bytes < db->memtable_limit) return LSM_OK;
+
+    int res = LSM_OK; //the pair is in, an error from here on is the engine's (see lsm.h)
+    pthread_mutex_lock(&db->lock);
+    if(db->flush_error || LSM_OK != lsm_freeze(db)){
+        res = LSM_ERR;
+    }
+    while(LSM_OK == res && db->frozen_count > LSM_MAX_FROZEN && !db->flush_error){ //the flusher is behind
+        pthread_cond_wait(&db->cond, &db->lock);
+    }
+    pthread_mutex_unlock(&db->lock);
+    return res;
+}
+
+int lsm_put(struct lsm *db, const char *key, const char *value){
+    if(NULL == value) return LSM_ERR;
+    return lsm_write(db, key, value);
+}
+
+int lsm_del(struct lsm *db, const char *key){
+    return lsm_write(db, key, NULL);
+}
+
+//what a get reads, pinned under db->lock as the iterator pins its sources, so that the memtable walk
+//and the block reads need no lock
+struct lsm_pins{
+    int mt_count;
+    struct lsm_memtable **mts; //the active one, then the frozen ones newest first
+    int table_count;
+    struct lsm_table **tables; //newest first
+};
+
+static int lsm_pin(struct lsm *db, struct lsm_pins *p){
+    struct lsm_memtable *mt = NULL;
+    struct lsm_table *t = NULL;
+    int i = 0;
+    pthread_mutex_lock(&db->lock);
+    p->mt_count = 1 + db->frozen_count;
+    p->table_count = 0;
+    for(t = db->tables; NULL != t; t = t->next) p->table_count += 1;
+    p->mts = malloc(p->mt_count * sizeof(*p->mts));
+    p->tables = malloc((p->table_count + 1) * sizeof(*p->tables));
+    if(NULL == p->mts || NULL == p->tables){
+        pthread_mutex_unlock(&db->lock);
+        free(p->mts);
+        free(p->tables);
+        return LSM_ERR;
+    }
+    for(mt = db->active; NULL != mt; mt = (mt == db->active) ? db->frozen : mt->next){
+        mt->refs += 1;
+        p->mts[i++] = mt;
+    }
+    for(i = 0, t = db->tables; NULL != t; t = t->next){
+        t->refs += 1;
+        p->tables[i++] = t;
+    }
+    pthread_mutex_unlock(&db->lock);
+    return LSM_OK;
+}
+
+static void lsm_unpin(struct lsm *db, struct lsm_pins *p, unsigned long bloom_skips){
+    int i = 0;
+    pthread_mutex_lock(&db->lock);
+    for(; i < p->mt_count; i++) lsm_memtable_unref(p->mts[i]);
+    for(i = 0; i < p->table_count; i++) lsm_table_unref(p->tables[i]);
+    db->bloom_skips += bloom_skips;
+    pthread_mutex_unlock(&db->lock);
+    free(p->mts);
+    free(p->tables);
+}
+
+char *lsm_get(struct lsm *db, const char *key){
+    int state = LSM_ABSENT, i = 0;
+    unsigned long bloom_skips = 0;
+    char *res = NULL;
+    struct lsm_pins p;
+    if(NULL == key || !lsm_key_fits(key) || LSM_OK != lsm_pin(db, &p)) return NULL;
+    for(; LSM_ABSENT == state && i < p.mt_count; i++){ //frozen memtables are read only, the active one is ours
+        struct map_pair *pair = map_get(p.mts[i]->map, (void *)key);
+        if(NULL != pair){
+            state = NULL != pair->value ? LSM_FOUND : LSM_DELETED;
+            if(LSM_FOUND == state) res = strdup(pair->value);
+        }
+    }
+    for(i = 0; LSM_ABSENT == state && i < p.table_count; i++){ //block reads go on while the flusher works
+        struct lsm_table *t = p.tables[i];
+        if(!lsm_bloom_test(t, key)){
+            bloom_skips += 1;
+            continue;
+        }
+        struct lsm_cursor c = { 0 };
+        lsm_cursor_seek(&c, t, key);
+        if(NULL != c.key && 0 == strcmp(c.key, key)){
+            state = NULL != c.value ? LSM_FOUND : LSM_DELETED;
+            if(LSM_FOUND == state) res = strdup(c.value);
+        }
+        free(c.data);
+    }
+    lsm_unpin(db, &p, bloom_skips);
+    return res;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// merge iterator
+///////////////////////////////////////////////////////////////////////////////
+//one memtable or table, 'key' and 'value' are its current pair, 'key' is NULL once it is exhausted
+struct lsm_source{
+    struct lsm_memtable *mt;
+    struct map_iterator mi;
+    struct lsm_cursor cursor;
+    const char *key;
+    const char *value;
+};
+
+struct lsm_iterator{
+    struct lsm *db;
+    char *hi;
+    int last; //source of the pair handed out last, it and its duplicates move on at the next call
+    int count;
+    struct lsm_source sources[]; //newest first
+};
+
+static void lsm_source_next(struct lsm_source *s){
+    if(NULL != s->mt){
+        struct map_pair *pair = map_iterator_next(&s->mi);
+        s->key = NULL != pair ? pair->key : NULL;
+        s->value = NULL != pair ? pair->value : NULL;
+    }else{
+        lsm_cursor_step(&s->cursor);
+        s->key = s->cursor.key;
+        s->value = s->cursor.value;
+    }
+}
+
+//moves every source standing on the key of source 'k' past it, 'k' itself last as the key lives there
+static void lsm_iterator_skip(struct lsm_iterator *it, int k){
+    int i = 0;
+    for(; i < it->count; i++){
+        if(i != k && NULL != it->sources[i].key && 0 == strcmp(it->sources[i].key, it->sources[k].key)){
+            lsm_source_next(&it->sources[i]);
+        }
+    }
+    lsm_source_next(&it->sources[k]);
+}
+
+struct lsm_iterator *lsm_iterator_range(struct lsm *db, const char *lo, const char *hi){
+    struct lsm_memtable *mt = NULL;
+    struct lsm_table *t = NULL;
+    int count = 1, i = 0;
+    if((NULL != lo && !lsm_key_fits(lo)) || (NULL != hi && !lsm_key_fits(hi))) return NULL;
+    pthread_mutex_lock(&db->lock);
+    count += db->frozen_count;
+    for(t = db->tables; NULL != t; t = t->next) count += 1;
+    struct lsm_iterator *it = calloc(1, sizeof(*it) + count * sizeof(struct lsm_source));
+    if(NULL == it || (NULL != hi && NULL == (it->hi = strdup(hi)))){
+        pthread_mutex_unlock(&db->lock);
+        free(it);
+        return NULL;
+    }
+    it->db = db;
+    it->last = -1;
+    it->count = count;
+    for(mt = db->active; NULL != mt; mt = (mt == db->active) ? db->frozen : mt->next){
+        mt->refs += 1;
+        it->sources[i++].mt = mt;
+    }
+    for(t = db->tables; NULL != t; t = t->next){
+        t->refs += 1;
+        it->sources[i++].cursor.table = t;
+    }
+    pthread_mutex_unlock(&db->lock);
+
+    for(i = 0; i < count; i++){ //pinned, the rest needs no lock
+        struct lsm_source *s = &it->sources[i];
+        if(NULL != s->mt){
+            s->mi = map_iterator_range(s->mt->map, (char *)lo, (char *)hi);
+            lsm_source_next(s);
+        }else{
+            lsm_cursor_seek(&s->cursor, s->cursor.table, lo);
+            s->key = s->cursor.key;
+            s->value = s->cursor.value;
+        }
+    }
+    return it;
+}
+
+//k is the number of memtables and tables, a handful: the smallest key is picked by a scan, the first
+//(newest) source holding it wins
+int lsm_iterator_next(struct lsm_iterator *it, const char **key, const char **value){
+    if(0 <= it->last){
+        lsm_iterator_skip(it, it->last);
+        it->last = -1;
+    }
+    for(;;){
+        int min = -1, i = 0;
+        for(; i < it->count; i++){
+            if(NULL != it->sources[i].key && (0 > min || strcmp(it->sources[i].key, it->sources[min].key) < 0)){
+                min = i;
+            }
+        }
+        if(0 > min || (NULL != it->hi && strcmp(it->sources[min].key, it->hi) > 0)) return 0;
+        if(NULL == it->sources[min].value){ //deleted, older versions are shadowed as well
+            lsm_iterator_skip(it, min);
+            continue;
+        }
+        *key = it->sources[min].key;
+        *value = it->sources[min].value;
+        it->last = min;
+        return 1;
+    }
+}
+
+void lsm_iterator_free(struct lsm_iterator *it){
+    if(NULL == it) return;
+    int i = 0;
+    pthread_mutex_lock(&it->db->lock);
+    for(; i < it->count; i++){
+        if(NULL != it->sources[i].mt){
+            lsm_memtable_unref(it->sources[i].mt);
+        }else{
+            lsm_table_unref(it->sources[i].cursor.table);
+        }
+    }
+    pthread_mutex_unlock(&it->db->lock);
+    for(i = 0; i < it->count; i++){
+        free(it->sources[i].cursor.data);
+    }
+    free(it->hi);
+    free(it);
+}
@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LSM_H_
+#define __LSM_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "map.h"
+
+//log-structured engine over struct map: writes go to the active memtable, a full one is frozen and a
+//background thread streams it into an immutable sorted table (data blocks, a block index and a bloom
+//filter), then drops it. Reads look at the memtables newest first, then the tables newest first.
+//One user thread; the flusher only ever touches frozen memtables and the table list
+#define LSM_OK 0
+#define LSM_ERR -1
+#define LSM_BLOCK_SIZE 4096   //data block target, a record never straddles two
+#define LSM_BLOOM_BITS 10     //per key, about 1% false positives
+#define LSM_MAX_FROZEN 2      //puts wait for the flusher beyond this many frozen memtables
+
+struct lsm_table;
+
+struct lsm_memtable{
+    struct map *map;  //a NULL value is a delete
+    size_t bytes;     //approximate, overwrites are not subtracted
+    int refs;
+    struct lsm_memtable *next;
+};
+
+struct lsm{
+    char *dir;
+    size_t memtable_limit;
+    struct lsm_memtable *active;
+    struct lsm_memtable *frozen; //newest first
+    int frozen_count;
+    struct lsm_table *tables;    //newest first
+    int next_id;                 //file name of the next table
+    int flush_error;
+    int stop;
+    unsigned long flushes;
+    unsigned long bloom_skips;   //table reads a bloom filter saved
+    pthread_mutex_t lock;        //the lists, refs and counters
+    pthread_cond_t cond;
+    pthread_t flusher;
+};
+
+//opens the tables already in 'dir' (which must exist), memtables freeze at 'memtable_limit' bytes
+struct lsm *lsm_open(const char *dir, size_t memtable_limit);
+//flushes every memtable and closes the engine
+int lsm_close(struct lsm *db);
+//keys are 1..MAP_MAX_KEY_LEN bytes, LSM_ERR otherwise. A write that fills the memtable also freezes it;
+//LSM_ERR from that freeze, or after a flush failed, comes with the pair already in the memtable and
+//visible to reads, so it reports the engine's state rather than a lost write
+int lsm_put(struct lsm *db, const char *key, const char *value);
+int lsm_del(struct lsm *db, const char *key);
+//a malloc'd copy of the value, NULL if absent or the key is too long to be stored
+char *lsm_get(struct lsm *db, const char *key);
+//freezes the active memtable and waits until every frozen one is a table
+int lsm_flush(struct lsm *db);
+
+//merges the memtables and tables in key order, the newest version of a key wins and deletes are skipped.
+//Pins what it reads; no puts or dels while one is open
+struct lsm_iterator;
+//keys in ['lo', 'hi'], a NULL bound is open; NULL if a bound is longer than MAP_MAX_KEY_LEN
+struct lsm_iterator *lsm_iterator_range(struct lsm *db, const char *lo, const char *hi);
+//1 and the next pair, valid until the following call, or 0 at the end
+int lsm_iterator_next(struct lsm_iterator *it, const char **key, const char **value);
+void lsm_iterator_free(struct lsm_iterator *it);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,158 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "lsm.h"
+
+#define DB_DIR "lsm_test.db"
+
+///////////////////////////////////////////////////////////////////////////////
+// test
+///////////////////////////////////////////////////////////////////////////////
+static char *make_key(int i){
+    static char key[32];
+    sprintf(key, "key%07d", i);
+    return key;
+}
+
+static void remove_db(){
+    DIR *dir = opendir(DB_DIR);
+    struct dirent *entry = NULL;
+    char path[512];
+    if(NULL == dir) return;
+    while(NULL != (entry = readdir(dir))){
+        if('.' == entry->d_name[0]) continue;
+        snprintf(path, sizeof(path), "%s/%s", DB_DIR, entry->d_name);
+        unlink(path);
+    }
+    closedir(dir);
+    rmdir(DB_DIR);
+}
+
+//values[i] is what key i should hold, NULL if absent
+static void check(struct lsm *db, char **values, int count){
+    int i = 0, seen = 0, expect = 0;
+    for(; i < count; i++){
+        char *value = lsm_get(db, make_key(i));
+        assert(NULL == values[i] ? NULL == value : (NULL != value && 0 == strcmp(values[i], value)));
+        free(value);
+    }
+
+    //the merged scan yields the live keys once each, in order
+    const char *key = NULL, *value = NULL;
+    struct lsm_iterator *it = lsm_iterator_range(db, NULL, NULL);
+    assert(NULL != it);
+    for(i = 0; i < count; i++){
+        if(NULL == values[i]) continue;
+        assert(1 == lsm_iterator_next(it, &key, &value));
+        assert(0 == strcmp(make_key(i), key) && 0 == strcmp(values[i], value));
+        seen += 1;
+    }
+    assert(0 == lsm_iterator_next(it, &key, &value));
+    lsm_iterator_free(it);
+
+    int lo = count / 3, hi = count / 2;
+    char lo_key[32];
+    strcpy(lo_key, make_key(lo));
+    it = lsm_iterator_range(db, lo_key, make_key(hi));
+    assert(NULL != it);
+    for(i = lo; i <= hi; i++){
+        if(NULL == values[i]) continue;
+        assert(1 == lsm_iterator_next(it, &key, &value) && 0 == strcmp(make_key(i), key));
+        expect += 1;
+    }
+    assert(0 == lsm_iterator_next(it, &key, &value));
+    lsm_iterator_free(it);
+    assert(seen >= expect);
+}
+
+void cover_testing(int count, int ops) __attribute__((unused));
+void cover_testing(int count, int ops) {
+    char **values = calloc(count, sizeof(*values));
+    assert(NULL != values);
+    remove_db();
+    assert(0 == mkdir(DB_DIR, 0755));
+    struct lsm *db = lsm_open(DB_DIR, 256 * 1024);
+    assert(NULL != db);
+    assert(LSM_ERR == lsm_put(db, "", "empty") && LSM_ERR == lsm_put(db, "k", NULL));
+
+    //a key past MAP_MAX_KEY_LEN shares its prefix with a stored key, it is absent before and after a flush
+    const char *full = "abcdefghijklmnopqrstuvwxyz012345", *longer = "abcdefghijklmnopqrstuvwxyz012345-extra";
+    assert(MAP_MAX_KEY_LEN == strlen(full) && LSM_ERR == lsm_put(db, longer, "v"));
+    assert(LSM_OK == lsm_put(db, full, "v") && NULL == lsm_get(db, longer) && NULL == lsm_iterator_range(db, longer, NULL));
+    assert(LSM_OK == lsm_flush(db) && NULL == lsm_get(db, longer) && NULL == lsm_iterator_range(db, NULL, longer));
+    char *value = lsm_get(db, full);
+    assert(NULL != value && 0 == strcmp("v", value));
+    free(value);
+    assert(LSM_OK == lsm_del(db, full));
+
+    int i = 0;
+    int64_t start = getCurrentTime();
+    for(; i < ops; i++){ //puts, overwrites and deletes spread over every memtable and table
+        int k = random_range(0, count - 1);
+        free(values[k]);
+        values[k] = NULL;
+        if(random() % 4){
+            values[k] = random_str(random_range(1, 64));
+            assert(LSM_OK == lsm_put(db, make_key(k), values[k]));
+        }else{
+            assert(LSM_OK == lsm_del(db, make_key(k)));
+        }
+    }
+    printf("write time consuming:%ld ops:%d flushes:%lu\n", getCurrentTime() - start, ops, db->flushes);
+    assert(db->flushes > 0);
+
+    start = getCurrentTime();
+    check(db, values, count);
+    printf("check time consuming:%ld count:%d bloom skips:%lu\n", getCurrentTime() - start, count, db->bloom_skips);
+    for(i = count; i < count + 1000; i++){ //misses mostly stop at the bloom filters
+        assert(NULL == lsm_get(db, make_key(i)));
+    }
+
+    //tables survive a restart, the memtables are flushed on close
+    assert(LSM_OK == lsm_close(db));
+    assert(NULL != (db = lsm_open(DB_DIR, 256 * 1024)));
+    check(db, values, count);
+    for(i = 0; i < count; i += 7){ //newer deletes shadow the flushed versions
+        free(values[i]);
+        values[i] = NULL;
+        assert(LSM_OK == lsm_del(db, make_key(i)));
+    }
+    check(db, values, count);
+    assert(LSM_OK == lsm_flush(db));
+    check(db, values, count);
+    assert(LSM_OK == lsm_close(db));
+
+    for(i = 0; i < count; i++){
+        free(values[i]);
+    }
+    free(values);
+    remove_db();
+}
+
+int main(){
+    cover_testing(20000, 200000);
+    printf("over\n");
+    return 0;
+}
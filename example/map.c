@@ -21,41 +21,90 @@
 #include <sys/time.h>
 #include <assert.h>
 
-#include "utils.h"
 #include "skiplist.h"
+#include "skiplist_arena.h"
+#include "skiplist_image.h"
+#include "skiplist_mvcc.h"
+#include "skiplist_hash.h"
+#include "map.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // map
 ///////////////////////////////////////////////////////////////////////////////
-#define MAP_OK 0
-#define MAP_ERR -1
-#define MAP_MAX_KEY_LEN 32
+//the leading bytes as one integer, zero padded, so integer order is strncmp order
+static inline uint64_t map_key_prefix(const char *key){
+    uint64_t prefix = 0;
+    int i = 0;
+    for(; NULL != key && i < 8 && '\0' != key[i]; i++){
+        prefix |= (uint64_t)(unsigned char)key[i] << (56 - 8 * i);
+    }
+    return prefix;
+}
 
-struct map_pair{
-    struct skiplist_node node;
-    char *key;
-    char *value;
-};
+SKIPLIST_VERSION_CHECK(struct map_pair, version, node);
 
-struct map{
-    struct skiplist sl;
-};
+//hashes the bytes map_key_cmp looks at, a word at a time
+static inline uint64_t map_key_hash(const char *key){
+    size_t len = strnlen(key, MAP_MAX_KEY_LEN), i = 0;
+    uint64_t hash = len;
+    for(; i < len; i += 8){
+        uint64_t word = 0;
+        memcpy(&word, key + i, len - i < 8 ? len - i : 8);
+        hash = skiplist_hash_mix(hash, word);
+    }
+    return hash;
+}
 
-static int map_pair_cmp(void *k1, void *k2){
-    struct map_pair *i = (struct map_pair *)k1, *j = (struct map_pair *)k2;
+static int map_key_cmp(void *k1, void *k2){
+    struct map_pair *i = skiplist_entry(k1, struct map_pair, node), *j = skiplist_entry(k2, struct map_pair, node);
+#if MAP_KEY_PREFIX
+    if(i->prefix != j->prefix){ //decided without touching the key buffers
+        return i->prefix < j->prefix ? -1 : 1;
+    }
+    if(0 == (i->prefix & 0xFF)){ //both keys end inside the prefix
+        return 0;
+    }
+#endif
     return strncmp(i->key, j->key, MAP_MAX_KEY_LEN);
 }
 
+static int map_pair_cmp(void *k1, void *k2){
+    int res = map_key_cmp(k1, k2);
+    return 0 != res ? res : skiplist_version_cmp(k1, k2);
+}
+
 void map_pair_free(struct map_pair *pair){
     if(NULL != pair){
-        if(NULL != pair->key)
-           free(pair->key);
-        if(NULL != pair->value)
-           free(pair->value);
+        if(skiplist_node_tail(&pair->node) != pair->key){ //inline ones go with the pair
+            if(NULL != pair->key)
+               free(pair->key);
+            if(NULL != pair->value)
+               free(pair->value);
+        }
         free(pair);
     }
 }
 
+static size_t map_str_size(const char *str){
+    return NULL != str ? strlen(str) + 1 : 0;
+}
+
+void map_pair_release(struct map *m, struct map_pair *pair){
+    if(NULL == m->arena){
+        map_pair_free(pair);
+        return;
+    }
+    if(NULL == pair) return;
+    size_t size = skiplist_node_size(sizeof(*pair), offsetof(struct map_pair, node), pair->node.level);
+    if(skiplist_node_tail(&pair->node) == pair->key){
+        size += map_str_size(pair->key) + map_str_size(pair->value);
+    }else{
+        skiplist_arena_free(m->arena, pair->key, map_str_size(pair->key));
+        skiplist_arena_free(m->arena, pair->value, map_str_size(pair->value));
+    }
+    skiplist_arena_free(m->arena, pair, size);
+}
+
 struct map *map_create(){
     struct map *m = calloc(1, sizeof(*m));
     if(NULL == m) goto err;
@@ -68,54 +117,344 @@ err:
     return NULL;
 }
 
+static void map_pair_reclaim(struct skiplist_node *node, void *arg){
+    map_pair_release((struct map *)arg, skiplist_entry(node, struct map_pair, node));
+}
+
+struct map *map_create_mvcc(){
+    struct map *m = map_create();
+    if(NULL == m) goto err;
+    if(NULL == (m->mvcc = malloc(sizeof(*m->mvcc)))) goto err;
+    skiplist_mvcc_init(m->mvcc, map_key_cmp, map_pair_reclaim, m);
+    return m;
+
+err:
+    if(NULL != m)
+        free(m);
+    return NULL;
+}
+
+int map_index(struct map *m){
+    if(NULL != m->mvcc || NULL != m->hash) return MAP_ERR;
+    if(NULL == (m->hash = malloc(sizeof(*m->hash)))) goto err;
+    if(SKIPLIST_OK != skiplist_hash_init(m->hash, map_pair_cmp, ((struct skiplist *)m)->busy)) goto err;
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){ //sized up front, nothing can fail
+        skiplist_hash_put(m->hash, map_key_hash(skiplist_entry(pos, struct map_pair, node)->key), pos);
+    }
+    return MAP_OK;
+
+err:
+    if(NULL != m->hash)
+        free(m->hash);
+    m->hash = NULL;
+    return MAP_ERR;
+}
+
+struct map *map_create_arena(size_t chunk_size){
+    struct map *m = map_create();
+    if(NULL == m) goto err;
+    if(NULL == (m->arena = malloc(sizeof(*m->arena)))) goto err;
+    skiplist_arena_init(m->arena, chunk_size);
+    return m;
+
+err:
+    if(NULL != m)
+        free(m);
+    return NULL;
+}
+
+struct map_pair *map_pair_create(struct map *m){
+    if(NULL != m->arena){
+        return SKIPLIST_NODE_ALLOC_ARENA((struct skiplist *)m, m->arena, struct map_pair, node, 0);
+    }
+    return SKIPLIST_NODE_ALLOC((struct skiplist *)m, struct map_pair, node);
+}
+
+struct map_pair *map_pair_create_inline(struct map *m, const char *key, const char *value){
+    size_t key_size = map_str_size(key), value_size = map_str_size(value);
+    struct map_pair *pair = NULL;
+    if(NULL != m->arena){
+        pair = SKIPLIST_NODE_ALLOC_ARENA((struct skiplist *)m, m->arena, struct map_pair, node, key_size + value_size);
+    }else{
+        int level = skiplist_random_level((struct skiplist *)m);
+        size_t size = skiplist_node_size(sizeof(*pair), offsetof(struct map_pair, node), level);
+        if(NULL != (pair = calloc(1, size + key_size + value_size))) pair->node.level = level;
+    }
+    if(NULL == pair) return NULL;
+    pair->key = memcpy(skiplist_node_tail(&pair->node), key, key_size);
+    if(NULL != value){
+        pair->value = memcpy(pair->key + key_size, value, value_size);
+    }
+    return pair;
+}
+
+char *map_strdup(struct map *m, const char *str){
+    return NULL != m->arena ? skiplist_arena_strdup(m->arena, str) : strdup(str);
+}
+
+//indexes a pair just linked, or unlinks it again if the index cannot grow
+static int map_hash_put(struct map *m, struct map_pair *pair){
+    if(SKIPLIST_OK != skiplist_hash_put(m->hash, map_key_hash(pair->key), &pair->node)){
+        skiplist_del((struct skiplist *)m, &pair->node);
+        return MAP_ERR;
+    }
+    return MAP_OK;
+}
+
 int map_put(struct map *m, struct map_pair *pair){
-    return SKIPLIST_OK == skiplist_put((struct skiplist *)m, (struct skiplist_node *)pair) ? MAP_OK : MAP_ERR;
+    pair->prefix = map_key_prefix(pair->key);
+    if(NULL != m->mvcc){
+        if(NULL != map_get(m, pair->key)) return MAP_ERR;
+        return SKIPLIST_OK == skiplist_mvcc_put((struct skiplist *)m, m->mvcc, &pair->node) ? MAP_OK : MAP_ERR;
+    }
+    if(NULL != m->hash){ //duplicates are turned away before any descent
+        if(NULL != map_get(m, pair->key) || SKIPLIST_OK != skiplist_put((struct skiplist *)m, &pair->node)){
+            return MAP_ERR;
+        }
+        return map_hash_put(m, pair);
+    }
+    return SKIPLIST_OK == skiplist_put((struct skiplist *)m, &pair->node) ? MAP_OK : MAP_ERR;
+}
+
+int map_set(struct map *m, struct map_pair *pair){
+    struct skiplist_node *old_node = NULL;
+    pair->prefix = map_key_prefix(pair->key);
+    if(NULL != m->mvcc){ //the old version goes once no snapshot sees it
+        return SKIPLIST_OK == skiplist_mvcc_put((struct skiplist *)m, m->mvcc, &pair->node) ? MAP_OK : MAP_ERR;
+    }
+    if(SKIPLIST_OK != skiplist_upsert((struct skiplist *)m, &pair->node, &old_node)){
+        return MAP_ERR;
+    }
+    if(NULL != old_node){
+        if(NULL != m->hash) skiplist_hash_replace(m->hash, map_key_hash(pair->key), old_node, &pair->node);
+        map_pair_release(m, skiplist_entry(old_node, struct map_pair, node));
+    }else if(NULL != m->hash){
+        return map_hash_put(m, pair);
+    }
+    return MAP_OK;
+}
+
+struct map_pair *map_replace(struct map *m, struct map_pair *pair){
+    pair->prefix = map_key_prefix(pair->key);
+    struct skiplist_node *old_node = skiplist_replace((struct skiplist *)m, &pair->node);
+    if(NULL != old_node && NULL != m->hash){
+        skiplist_hash_replace(m->hash, map_key_hash(pair->key), old_node, &pair->node);
+    }
+    return NULL != old_node ? skiplist_entry(old_node, struct map_pair, node) : NULL;
 }
 
 struct map_pair *map_get(struct map *m, void *key){
-    struct map_pair pair = { .key=key, .value=NULL };
-    return (struct map_pair *)skiplist_get((struct skiplist *)m, (struct skiplist_node *)&pair);
+    if(NULL != m->mvcc){
+        return map_snapshot_get(m, NULL, key);
+    }
+    struct map_pair pair = { .key=key, .value=NULL, .prefix=map_key_prefix(key) };
+    struct skiplist_node *node = NULL != m->hash ? skiplist_hash_get(m->hash, map_key_hash(key), &pair.node) :
+                                    skiplist_get((struct skiplist *)m, &pair.node);
+    return NULL != node ? skiplist_entry(node, struct map_pair, node) : NULL;
+}
+
+#define MAP_BATCH 64
+
+void map_get_batch(struct map *m, char **keys, int n, struct map_pair **out){
+    struct map_pair probes[MAP_BATCH];
+    struct skiplist_node *nodes[MAP_BATCH], *found[MAP_BATCH];
+    int base = 0;
+    if(NULL != m->hash){ //no descents to overlap
+        for(; base < n; base++){
+            out[base] = map_get(m, keys[base]);
+        }
+        return;
+    }
+    for(; base < n; base += MAP_BATCH){
+        int count = n - base < MAP_BATCH ? n - base : MAP_BATCH, i = 0;
+        for(; i < count; i++){
+            probes[i] = (struct map_pair){ .key = keys[base + i], .value = NULL, .prefix = map_key_prefix(keys[base + i]) };
+            nodes[i] = &probes[i].node;
+        }
+        skiplist_get_batch((struct skiplist *)m, nodes, count, found);
+        for(i = 0; i < count; i++){
+            out[base + i] = NULL != found[i] ? skiplist_entry(found[i], struct map_pair, node) : NULL;
+        }
+    }
 }
 
 int map_del(struct map *m, void *key){
-    struct map_pair *del_item = map_get(m, key);
-    if(NULL != del_item && SKIPLIST_OK == skiplist_del((struct skiplist *)m, (struct skiplist_node *)del_item)){
-        map_pair_free((struct map_pair *)del_item);
+    if(NULL != m->mvcc){
+        struct map_pair *tombstone = map_pair_create_inline(m, key, NULL);
+        if(NULL == tombstone) return MAP_ERR;
+        tombstone->prefix = map_key_prefix(key);
+        if(SKIPLIST_OK != skiplist_mvcc_del((struct skiplist *)m, m->mvcc, &tombstone->node)){
+            map_pair_release(m, tombstone);
+            return MAP_ERR;
+        }
+        return MAP_OK;
+    }
+    struct map_pair pair = { .key=key, .value=NULL, .prefix=map_key_prefix(key) };
+    struct skiplist_node *del_node = NULL;
+    if(NULL != m->hash){ //misses end here, hits still descend to unlink
+        uint64_t hash = map_key_hash(key);
+        if(NULL != (del_node = skiplist_hash_get(m->hash, hash, &pair.node))){
+            skiplist_del((struct skiplist *)m, del_node);
+            skiplist_hash_del(m->hash, hash, del_node);
+        }
+    }else{
+        del_node = skiplist_remove((struct skiplist *)m, &pair.node);
+    }
+    if(NULL != del_node){
+        map_pair_release(m, skiplist_entry(del_node, struct map_pair, node));
         return MAP_OK;
     }
     return MAP_ERR;
 }
 
+int map_rank(struct map *m, void *key){
+    struct map_pair pair = { .key=key, .value=NULL, .prefix=map_key_prefix(key) };
+    return skiplist_rank((struct skiplist *)m, &pair.node);
+}
+
+struct map_pair *map_select(struct map *m, int rank){
+    struct skiplist_node *node = skiplist_select((struct skiplist *)m, rank);
+    return NULL != node ? skiplist_entry(node, struct map_pair, node) : NULL;
+}
+
+int map_load(struct map *m, struct map_pair **pairs, int n){
+    struct skiplist_node **nodes = malloc(n * sizeof(*nodes));
+    if(NULL == nodes) return MAP_ERR;
+    int i = 0;
+    for(; i < n; i++){
+        pairs[i]->prefix = map_key_prefix(pairs[i]->key);
+        nodes[i] = &pairs[i]->node;
+    }
+    int res = skiplist_bulk_load((struct skiplist *)m, nodes, n);
+    for(i = 0; SKIPLIST_OK == res && NULL != m->hash && i < n; i++){
+        if(SKIPLIST_OK != skiplist_hash_put(m->hash, map_key_hash(pairs[i]->key), nodes[i])){
+            while(i > 0){ //the index could not grow, take the whole load back
+                i -= 1;
+                skiplist_hash_del(m->hash, map_key_hash(pairs[i]->key), nodes[i]);
+            }
+            for(; i < n; i++){
+                skiplist_del((struct skiplist *)m, nodes[i]);
+            }
+            res = SKIPLIST_ERR;
+        }
+    }
+    free(nodes);
+    return SKIPLIST_OK == res ? MAP_OK : MAP_ERR;
+}
+
 void map_free(struct map *m){
     if(NULL == m) return;
-    struct skiplist_node *pos, *iter = NULL;
-    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){
-        struct map_pair *pair = (struct map_pair *)pos;
-        map_del(m, pair->key);
+    if(NULL != m->arena){ //every pair, key and value lives in the arena, drop it whole
+        skiplist_destroy((struct skiplist *)m);
+        skiplist_arena_destroy(m->arena);
+        free(m->arena);
+    }else{
+        struct skiplist_node *pos, *iter = NULL;
+        SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){ //one pass, no searches
+            map_pair_free(skiplist_entry(pos, struct map_pair, node));
+        }
+    }
+    if(NULL != m->mvcc)
+        free(m->mvcc);
+    if(NULL != m->hash){
+        skiplist_hash_destroy(m->hash);
+        free(m->hash);
     }
     free(m);
 }
 
-//iterator
-struct map_iterator{
-    struct skiplist_node *pos;
-    struct skiplist_node *end;
-};
+///////////////////////////////////////////////////////////////////////////////
+// split, join and sets
+///////////////////////////////////////////////////////////////////////////////
+static int map_movable(struct map *m){
+    return NULL == m->arena && NULL == m->mvcc && NULL == m->hash;
+}
+
+int map_split(struct map *m, char *key, struct map *out){
+    struct map_pair pair = { .key = key, .prefix = map_key_prefix(key) };
+    if(!map_movable(m) || !map_movable(out)) return MAP_ERR;
+    return SKIPLIST_OK == skiplist_split((struct skiplist *)m, &pair.node, (struct skiplist *)out) ? MAP_OK : MAP_ERR;
+}
 
+int map_join(struct map *m, struct map *other){
+    if(!map_movable(m) || !map_movable(other)) return MAP_ERR;
+    return SKIPLIST_OK == skiplist_join((struct skiplist *)m, (struct skiplist *)other) ? MAP_OK : MAP_ERR;
+}
+
+int map_union(struct map *m, struct map *other){
+    if(!map_movable(m) || !map_movable(other)) return MAP_ERR;
+    skiplist_union((struct skiplist *)m, (struct skiplist *)other);
+    return MAP_OK;
+}
+
+//releases every pair of 'out', which holds pairs cut from 'm'
+static int map_release_all(struct map *m, struct skiplist *out){
+    int count = out->busy;
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT(out, pos, iter){
+        struct map_pair *pair = skiplist_entry(pos, struct map_pair, node);
+        if(NULL != m->hash) skiplist_hash_del(m->hash, map_key_hash(pair->key), pos);
+        map_pair_release(m, pair);
+    }
+    return count;
+}
+
+int map_range_delete(struct map *m, char *lo, char *hi){
+    struct map_pair lo_pair = { .key = lo, .prefix = map_key_prefix(lo) }, hi_pair = { .key = hi, .prefix = map_key_prefix(hi) };
+    struct skiplist out;
+    if(NULL != m->mvcc) return MAP_ERR;
+    skiplist_init_maxlevel(&out, map_pair_cmp, ((struct skiplist *)m)->maxlevel);
+    skiplist_range_delete((struct skiplist *)m, NULL != lo ? &lo_pair.node : NULL, NULL != hi ? &hi_pair.node : NULL, &out);
+    return map_release_all(m, &out);
+}
+
+int map_subtract(struct map *m, struct map *other){
+    struct skiplist out;
+    if(NULL != m->mvcc || NULL != other->mvcc) return MAP_ERR;
+    skiplist_init_maxlevel(&out, map_pair_cmp, ((struct skiplist *)m)->maxlevel);
+    skiplist_difference((struct skiplist *)m, (struct skiplist *)other, &out);
+    return map_release_all(m, &out);
+}
+
+int map_intersect(struct map *m, struct map *other){
+    struct skiplist out;
+    if(NULL != m->mvcc || NULL != other->mvcc) return MAP_ERR;
+    skiplist_init_maxlevel(&out, map_pair_cmp, ((struct skiplist *)m)->maxlevel);
+    skiplist_intersection((struct skiplist *)m, (struct skiplist *)other, &out);
+    return map_release_all(m, &out);
+}
+
+//iterator
 struct map_iterator map_iterator_begin(struct map *m, char *key){
-    struct map_pair pair = { .key = key };
-    struct skiplist_node *start = skiplist_get((struct skiplist *)m, (struct skiplist_node *)&pair);
+    struct map_pair pair = { .key = key, .prefix = map_key_prefix(key) };
+    struct skiplist_node *start = skiplist_get((struct skiplist *)m, &pair.node);
     return (struct map_iterator){ 
                 .pos = start, 
                 .end = ((struct skiplist *)m)->header 
             };
 }
 
+struct map_iterator map_iterator_range(struct map *m, char *lo, char *hi){
+    struct map_pair lo_pair = { .key = lo, .prefix = map_key_prefix(lo) }, hi_pair = { .key = hi, .prefix = map_key_prefix(hi) };
+    struct skiplist_range range = skiplist_range_begin((struct skiplist *)m,
+                                        NULL != lo ? &lo_pair.node : NULL, NULL != hi ? &hi_pair.node : NULL);
+    return (struct map_iterator){
+                .pos = range.pos,
+                .end = range.end
+            };
+}
+
+int map_count(struct map *m, char *lo, char *hi){
+    struct map_pair lo_pair = { .key = lo, .prefix = map_key_prefix(lo) }, hi_pair = { .key = hi, .prefix = map_key_prefix(hi) };
+    return skiplist_range_count((struct skiplist *)m, NULL != lo ? &lo_pair.node : NULL, NULL != hi ? &hi_pair.node : NULL);
+}
+
 struct map_pair *map_iterator_prev(struct map_iterator *iter){
     struct skiplist_node *curr = iter->pos;
     if(NULL != curr && iter->end != curr){
-        iter->pos = curr->prev[0];
-        return (struct map_pair *)curr;
+        iter->pos = curr->prev;
+        return skiplist_entry(curr, struct map_pair, node);
     }
     return NULL;
 }
@@ -123,66 +462,155 @@ struct map_pair *map_iterator_prev(struct map_iterator *iter){
 struct map_pair *map_iterator_next(struct map_iterator *iter){
     struct skiplist_node *curr = iter->pos;
     if(NULL != curr && iter->end != curr){
-        iter->pos = curr->next[0];
-        return (struct map_pair *)curr;
+        iter->pos = curr->link[0].next;
+        return skiplist_entry(curr, struct map_pair, node);
     }
     return NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// test
+// snapshot
 ///////////////////////////////////////////////////////////////////////////////
-void stress_testing(struct map *m, int data_len, int count) __attribute__((unused));
-void stress_testing(struct map *m, int data_len, int count) {
-    int64_t start = getCurrentTime();
-    int i = 0;
-    for(; i < count; i++){
-        struct map_pair *pair = calloc(1, sizeof(*pair));
-        assert(NULL != (pair->key = random_str(data_len))); //the key and value cannot be the same; otherwise, they will be released twice
-        assert(NULL != (pair->value = random_str(data_len)));
-        assert(MAP_OK == map_put(m, pair));
-        assert(pair == map_get(m, pair->key));
+void map_snapshot_open(struct map *m, struct skiplist_snapshot *snap){
+    skiplist_snapshot_open(m->mvcc, snap);
+}
+
+void map_snapshot_release(struct map *m, struct skiplist_snapshot *snap){
+    skiplist_snapshot_release((struct skiplist *)m, m->mvcc, snap);
+}
+
+//a NULL 'snap' reads the latest versions
+struct map_pair *map_snapshot_get(struct map *m, struct skiplist_snapshot *snap, void *key){
+    struct map_pair pair = { .key=key, .value=NULL, .prefix=map_key_prefix(key) };
+    struct skiplist_node *node = skiplist_snapshot_get((struct skiplist *)m, m->mvcc, snap, &pair.node);
+    return NULL != node ? skiplist_entry(node, struct map_pair, node) : NULL;
+}
+
+struct map_snapshot_iterator map_snapshot_iterator_range(struct map *m, struct skiplist_snapshot *snap, char *lo, char *hi){
+    struct map_pair lo_pair = { .key = lo, .prefix = map_key_prefix(lo) };
+    return (struct map_snapshot_iterator){
+                .m = m,
+                .snap = snap,
+                .pos = skiplist_snapshot_seek((struct skiplist *)m, m->mvcc, snap, NULL != lo ? &lo_pair.node : NULL),
+                .hi = hi
+            };
+}
+
+struct map_pair *map_snapshot_iterator_next(struct map_snapshot_iterator *iter){
+    struct skiplist_node *curr = iter->pos;
+    if(NULL == curr) return NULL;
+    struct map_pair *pair = skiplist_entry(curr, struct map_pair, node);
+    if(NULL != iter->hi && 0 < strncmp(pair->key, iter->hi, MAP_MAX_KEY_LEN)){
+        iter->pos = NULL;
+        return NULL;
     }
-    printf("time consuming:%ld data_len:%d count:%d\n", getCurrentTime() - start, data_len, count);
+    iter->pos = skiplist_snapshot_next((struct skiplist *)iter->m, iter->m->mvcc, iter->snap, curr);
+    return pair;
 }
 
-void cover_testing(struct map *m) __attribute__((unused));
-void cover_testing(struct map *m) {
-    struct map_pair *old_pair = calloc(1, sizeof(*old_pair));
-    assert(NULL != (old_pair->key = strdup("test")));
-    assert(NULL != (old_pair->value = strdup("old")));
+///////////////////////////////////////////////////////////////////////////////
+// image
+///////////////////////////////////////////////////////////////////////////////
+//keys and values keep their terminator so the image hands out plain strings
+static int map_image_fields(struct skiplist_node *node, const void **key, size_t *key_len, const void **value, size_t *value_len){
+    struct map_pair *pair = skiplist_entry(node, struct map_pair, node);
+    *key = pair->key;
+    *key_len = map_str_size(pair->key);
+    *value = pair->value;
+    *value_len = map_str_size(pair->value);
+    return SKIPLIST_OK;
+}
 
-    struct map_pair *new_pair = calloc(1, sizeof(*new_pair));
-    assert(NULL != (new_pair->key = strdup("test")));
-    assert(NULL != (new_pair->value = strdup("new")));
+//keys are saved whole with their terminator, so the lengths bound the compare; capped at MAP_MAX_KEY_LEN
+//as the map tells keys apart by that many bytes only (strncmp order)
+static int map_image_cmp(const void *k1, size_t l1, const void *k2, size_t l2){
+    return skiplist_image_memcmp(k1, l1 < MAP_MAX_KEY_LEN ? l1 : MAP_MAX_KEY_LEN, k2, l2 < MAP_MAX_KEY_LEN ? l2 : MAP_MAX_KEY_LEN);
+}
 
-    assert(MAP_OK == map_put(m, old_pair));
-    assert(MAP_ERR == map_put(m, new_pair)); //duplicate values are not allowed to be inserted
-    assert(old_pair == map_get(m, (void *)"test"));
-    map_pair_free(new_pair);
+int map_save(struct map *m, const char *path){
+    return skiplist_image_save((struct skiplist *)m, map_image_fields, path);
 }
 
-int main(){
-    struct map *m = map_create();
+int map_image_open(struct skiplist_image *img, const char *path){
+    return skiplist_image_open(img, path, map_image_cmp);
+}
 
-    stress_testing(m, MAP_MAX_KEY_LEN, 100000);
-    cover_testing(m);
+void map_image_close(struct skiplist_image *img){
+    skiplist_image_close(img);
+}
 
-    int i = 0;
-    struct map_iterator iterator = map_iterator_begin(m, "test");
-    struct map_pair *curr = NULL;
-    while(NULL != (curr = map_iterator_next(&iterator))){
-        printf("key:%s value:%s\n", curr->key, curr->value);
-        assert(MAP_OK == map_del(m, curr->key));
-        if(++i >= 10){
-            break;
-        }
-    }
+const char *map_image_get(struct skiplist_image *img, const char *key){
+    const struct skiplist_image_node *node = skiplist_image_get(img, key, strlen(key) + 1);
+    return NULL != node ? (const char *)skiplist_image_value(node) : NULL;
+}
 
-    //free
-    printf("map size before free:%d\n", ((struct skiplist *)m)->busy);
-    map_free(m);
+///////////////////////////////////////////////////////////////////////////////
+// lock-free map
+///////////////////////////////////////////////////////////////////////////////
+static int lf_map_pair_cmp(void *k1, void *k2){
+    struct lf_map_pair *i = skiplist_entry(k1, struct lf_map_pair, node), *j = skiplist_entry(k2, struct lf_map_pair, node);
+    return strncmp(i->key, j->key, MAP_MAX_KEY_LEN);
+}
+
+//called from the epoch once the pair is unreachable, or at teardown
+static void lf_map_pair_free(struct skiplist_epoch_entry *entry){
+    struct lf_map_pair *pair = skiplist_entry(entry, struct lf_map_pair, node.retire);
+    free(pair->key);
+    free(pair->value);
+    free(pair);
+}
+
+struct lf_map *lf_map_create(){
+    struct lf_map *m = calloc(1, sizeof(*m));
+    if(NULL == m) return NULL;
+    skiplist_epoch_init(&m->epoch);
+    lfskiplist_init(&m->sl, lf_map_pair_cmp, lf_map_pair_free, &m->epoch);
+    return m;
+}
+
+void lf_map_free(struct lf_map *m){
+    if(NULL == m) return;
+    lfskiplist_destroy(&m->sl);
+    skiplist_epoch_destroy(&m->epoch);
+    free(m);
+}
+
+void lf_map_register(struct lf_map *m, struct skiplist_epoch_thread *thr){
+    skiplist_epoch_register(&m->epoch, thr);
+}
+
+void lf_map_enter(struct lf_map *m, struct skiplist_epoch_thread *thr){
+    skiplist_epoch_enter(&m->epoch, thr);
+}
+
+void lf_map_exit(struct skiplist_epoch_thread *thr){
+    skiplist_epoch_exit(thr);
+}
+
+int lf_map_put(struct lf_map *m, struct skiplist_epoch_thread *thr, const char *key, const char *value){
+    if(NULL == key || NULL == value) return MAP_ERR;
+    struct lf_map_pair *pair = LFSKIPLIST_NODE_ALLOC(&m->sl, struct lf_map_pair, node);
+    if(NULL == pair) return MAP_ERR;
+    if(NULL == (pair->key = strdup(key)) || NULL == (pair->value = strdup(value))) goto err;
+    if(SKIPLIST_OK != lfskiplist_put(&m->sl, thr, &pair->node)) goto err;
+    return MAP_OK;
+
+err: //never published, no other thread saw it
+    lf_map_pair_free(&pair->node.retire);
+    return MAP_ERR;
+}
+
+const char *lf_map_get(struct lf_map *m, const char *key){
+    struct lf_map_pair probe = { .key = (char *)key };
+    struct lfskiplist_node *node = lfskiplist_get(&m->sl, &probe.node);
+    return NULL != node ? skiplist_entry(node, struct lf_map_pair, node)->value : NULL;
+}
+
+int lf_map_del(struct lf_map *m, struct skiplist_epoch_thread *thr, const char *key){
+    struct lf_map_pair probe = { .key = (char *)key };
+    return SKIPLIST_OK == lfskiplist_del(&m->sl, thr, &probe.node) ? MAP_OK : MAP_ERR;
+}
 
-    printf("over\n");
-    return 0;
+int lf_map_busy(struct lf_map *m){
+    return __atomic_load_n(&m->sl.busy, __ATOMIC_RELAXED);
 }
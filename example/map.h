@@ -0,0 +1,181 @@
+/*
+ * 
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __MAP_H_
+#define __MAP_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "skiplist.h"
+#include "skiplist_mvcc.h"
+#include "skiplist_lockfree.h"
+
+#define MAP_OK 0
+#define MAP_ERR -1
+#define MAP_MAX_KEY_LEN 32
+#ifndef MAP_KEY_PREFIX
+#define MAP_KEY_PREFIX 1 //0 compares the full keys at every step
+#endif
+
+struct map_pair{
+    char *key;
+    char *value;
+    uint64_t prefix; //first 8 key bytes big-endian, filled in when the pair is put; ties fall back to the key
+    struct skiplist_version version; //seq 0 in an unversioned map
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+struct skiplist_arena;
+struct skiplist_image;
+struct skiplist_hash;
+
+struct map{
+    struct skiplist sl;
+    struct skiplist_arena *arena; //NULL: pairs, keys and values are malloc'd one by one
+    struct skiplist_mvcc *mvcc;   //NULL: one pair per key
+    struct skiplist_hash *hash;   //NULL: exact lookups descend the list
+};
+
+struct map_iterator{
+    struct skiplist_node *pos;
+    struct skiplist_node *end;
+};
+
+//frees a pair of a map without arena
+void map_pair_free(struct map_pair *pair);
+//frees a pair of 'm' that is not in the map, e.g. one map_replace handed back
+void map_pair_release(struct map *m, struct map_pair *pair);
+
+struct map *map_create();
+//pairs come from a per-map arena and map_free drops it without visiting them; their keys and values
+//must be inline (map_pair_create_inline) or come from map_strdup
+struct map *map_create_arena(size_t chunk_size);
+//versioned map (skiplist_mvcc.h): map_set and map_del add versions, map_put fails on a live key and
+//map_get reads the latest one; replaced and deleted pairs are released once no snapshot sees them.
+//Rank, select, count, load, batch gets, replace, the plain iterators and map_save see the raw versions
+struct map *map_create_mvcc();
+void map_free(struct map *m);
+//indexes every key in a hash table (skiplist_hash.h) kept in step from then on: gets, duplicate checks
+//and misses skip the descent, scans and ranks still walk the list. Not for versioned maps, and an
+//indexed map does not split, join or union
+int map_index(struct map *m);
+
+struct map_pair *map_pair_create(struct map *m);
+//key and value are copied into the pair's own block, right after the tower
+struct map_pair *map_pair_create_inline(struct map *m, const char *key, const char *value);
+char *map_strdup(struct map *m, const char *str);
+int map_put(struct map *m, struct map_pair *pair);
+//inserts 'pair' or replaces the pair with the same key, which is freed
+int map_set(struct map *m, struct map_pair *pair);
+//replaces the pair with the same key and returns it unfreed, NULL (and 'pair' is not taken) if absent
+struct map_pair *map_replace(struct map *m, struct map_pair *pair);
+struct map_pair *map_get(struct map *m, void *key);
+//out[i] receives the pair of keys[i] or NULL, the lookups overlap their cache misses
+void map_get_batch(struct map *m, char **keys, int n, struct map_pair **out);
+int map_del(struct map *m, void *key);
+
+//1-based position of 'key' in key order, 0 if absent
+int map_rank(struct map *m, void *key);
+//the pair at 1-based position 'rank', NULL if out of range
+struct map_pair *map_select(struct map *m, int rank);
+//appends pairs sorted ascending above every key already present in one pass, MAP_ERR if out of order
+int map_load(struct map *m, struct map_pair **pairs, int n);
+
+//number of keys in ['lo', 'hi'], a NULL bound is open
+int map_count(struct map *m, char *lo, char *hi);
+
+//pairs change maps by relinking towers at the cut, not one by one. Moves between maps need both
+//unversioned and without arena; MAP_ERR otherwise
+//moves the pairs >= 'key' into the empty map 'out', O(log n)
+int map_split(struct map *m, char *key, struct map *out);
+//appends every pair of 'other', all above the keys of 'm', and leaves 'other' empty, O(log n)
+int map_join(struct map *m, struct map *other);
+//moves the pairs of 'other' whose keys 'm' lacks into 'm', 'other' keeps the rest
+int map_union(struct map *m, struct map *other);
+//frees the pairs in ['lo', 'hi'] (a NULL bound is open) after unlinking them in O(log n), returns how many
+int map_range_delete(struct map *m, char *lo, char *hi);
+//frees the pairs of 'm' whose keys are (subtract) or are not (intersect) in 'other', returns how many
+int map_subtract(struct map *m, struct map *other);
+int map_intersect(struct map *m, struct map *other);
+
+struct map_iterator map_iterator_begin(struct map *m, char *key);
+//iterates the keys in ['lo', 'hi'] in order, a NULL bound is open
+struct map_iterator map_iterator_range(struct map *m, char *lo, char *hi);
+struct map_pair *map_iterator_prev(struct map_iterator *iter);
+struct map_pair *map_iterator_next(struct map_iterator *iter);
+
+//snapshots of a versioned map: a consistent view as of the open, unchanged by later writes
+void map_snapshot_open(struct map *m, struct skiplist_snapshot *snap);
+void map_snapshot_release(struct map *m, struct skiplist_snapshot *snap);
+struct map_pair *map_snapshot_get(struct map *m, struct skiplist_snapshot *snap, void *key);
+
+//stands on pairs the snapshot sees, so writes and deletes may run between steps; 'hi' must outlive it
+struct map_snapshot_iterator{
+    struct map *m;
+    struct skiplist_snapshot *snap;
+    struct skiplist_node *pos; //next pair to hand out, NULL at the end
+    char *hi;
+};
+
+//iterates the keys in ['lo', 'hi'] the snapshot sees, a NULL bound is open
+struct map_snapshot_iterator map_snapshot_iterator_range(struct map *m, struct skiplist_snapshot *snap, char *lo, char *hi);
+struct map_pair *map_snapshot_iterator_next(struct map_snapshot_iterator *iter);
+
+//writes every pair to 'path' as a read-only image (skiplist_image.h), replacing the file atomically
+int map_save(struct map *m, const char *path);
+//maps an image written by map_save, lookups run on the mapping with nothing rebuilt
+int map_image_open(struct skiplist_image *img, const char *path);
+void map_image_close(struct skiplist_image *img);
+//value of 'key' in the image, NULL if absent or saved as NULL
+const char *map_image_get(struct skiplist_image *img, const char *key);
+
+//lock-free map (skiplist_lockfree.h) for any number of threads, keys and values are copied in. Each
+//thread registers a record once and makes every call between lf_map_enter and lf_map_exit; a value
+//from lf_map_get stays readable until that exit. A deleted pair, key and value included, is freed
+//through the epoch once no thread can still see it
+struct lf_map_pair{
+    char *key;
+    char *value;
+    struct lfskiplist_node node; //must be last, the tower follows it
+};
+
+struct lf_map{
+    struct lfskiplist sl;
+    struct skiplist_epoch epoch;
+};
+
+struct lf_map *lf_map_create();
+//no thread may be inside; frees the pairs still in limbo, so the records must still be alive
+void lf_map_free(struct lf_map *m);
+//'thr' is the caller's and must outlive the map
+void lf_map_register(struct lf_map *m, struct skiplist_epoch_thread *thr);
+void lf_map_enter(struct lf_map *m, struct skiplist_epoch_thread *thr);
+void lf_map_exit(struct skiplist_epoch_thread *thr);
+//MAP_ERR if the key is present or 'value' is NULL
+int lf_map_put(struct lf_map *m, struct skiplist_epoch_thread *thr, const char *key, const char *value);
+//the value of 'key', NULL if absent
+const char *lf_map_get(struct lf_map *m, const char *key);
+int lf_map_del(struct lf_map *m, struct skiplist_epoch_thread *thr, const char *key);
+int lf_map_busy(struct lf_map *m);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
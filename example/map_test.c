@@ -0,0 +1,732 @@
+/*
+ * 
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "map.h"
+#include "skiplist_image.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// test
+///////////////////////////////////////////////////////////////////////////////
+void stress_testing(struct map *m, int data_len, int count) __attribute__((unused));
+void stress_testing(struct map *m, int data_len, int count) {
+    int64_t start = getCurrentTime();
+    int i = 0;
+    for(; i < count; i++){
+        struct map_pair *pair = map_pair_create(m);
+        assert(NULL != (pair->key = random_str(data_len))); //the key and value cannot be the same; otherwise, they will be released twice
+        assert(NULL != (pair->value = random_str(data_len)));
+        assert(MAP_OK == map_put(m, pair));
+        assert(pair == map_get(m, pair->key));
+    }
+    printf("time consuming:%ld data_len:%d count:%d\n", getCurrentTime() - start, data_len, count);
+}
+
+void batch_testing(struct map *m) __attribute__((unused));
+void batch_testing(struct map *m) {
+    int count = ((struct skiplist *)m)->busy + 100, i = 0;
+    char **keys = calloc(count, sizeof(*keys));
+    struct map_pair **out = calloc(count, sizeof(*out));
+    assert(NULL != keys && NULL != out);
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){
+        keys[i++] = skiplist_entry(pos, struct map_pair, node)->key;
+    }
+    for(; i < count; i++){ //misses mixed in
+        keys[i] = "~missing";
+    }
+    for(i = count - 1; i > 0; i--){
+        int j = random() % (i + 1);
+        char *tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    int64_t start = getCurrentTime();
+    for(i = 0; i < count; i++){
+        out[i] = map_get(m, keys[i]);
+    }
+    int64_t single = getCurrentTime() - start;
+    start = getCurrentTime();
+    for(i = 0; i < count; i += 128){
+        map_get_batch(m, keys + i, count - i < 128 ? count - i : 128, out + i);
+    }
+    printf("get time consuming:%ld batch:%ld count:%d\n", single, getCurrentTime() - start, count);
+    for(i = 0; i < count; i++){
+        assert(out[i] == map_get(m, keys[i]));
+        assert(NULL == out[i] || 0 == strcmp(out[i]->key, keys[i]));
+    }
+    free(keys);
+    free(out);
+}
+
+void bulk_testing(int count) __attribute__((unused));
+void bulk_testing(int count) {
+    struct map *m = map_create();
+    struct map_pair **pairs = calloc(count, sizeof(*pairs));
+    assert(NULL != m && NULL != pairs);
+    int i = 0;
+    for(; i < count; i++){ //sorted input with perfectly balanced towers
+        pairs[i] = SKIPLIST_NODE_ALLOC_LEVEL(struct map_pair, node, skiplist_bulk_level((struct skiplist *)m, i + 1));
+        assert(NULL != pairs[i]);
+        assert(NULL != (pairs[i]->key = malloc(16)) && NULL != (pairs[i]->value = strdup("bulk")));
+        sprintf(pairs[i]->key, "%08d", i);
+    }
+
+    struct map_pair *tmp = pairs[1]; //out of order input is rejected untouched
+    pairs[1] = pairs[2];
+    pairs[2] = tmp;
+    assert(MAP_ERR == map_load(m, pairs, count) && 0 == ((struct skiplist *)m)->busy);
+    pairs[2] = pairs[1];
+    pairs[1] = tmp;
+
+    int64_t start = getCurrentTime();
+    assert(MAP_OK == map_load(m, pairs, count / 2));
+    assert(MAP_OK == map_load(m, pairs + count / 2, count - count / 2)); //appends after existing keys
+    printf("bulk load time consuming:%ld count:%d\n", getCurrentTime() - start, count);
+    assert(MAP_ERR == map_load(m, pairs, 1)); //not above the last key
+
+    assert(count == ((struct skiplist *)m)->busy);
+    for(i = 0; i < count; i += 97){
+        assert(pairs[i] == map_get(m, pairs[i]->key));
+        assert(i + 1 == map_rank(m, pairs[i]->key));
+    }
+    assert(MAP_OK == map_del(m, pairs[count / 2]->key) && count / 2 + 1 == map_rank(m, pairs[count / 2 + 1]->key));
+    free(pairs);
+    map_free(m);
+}
+
+void arena_testing(int count) __attribute__((unused));
+void arena_testing(int count) {
+    struct map *m = map_create_arena(0), *plain = map_create();
+    char **keys = calloc(count, sizeof(*keys));
+    assert(NULL != m && NULL != plain && NULL != keys);
+    int i = 0;
+    for(; i < count; i++){
+        assert(NULL != (keys[i] = random_str(MAP_MAX_KEY_LEN)));
+        struct map_pair *pair = map_pair_create_inline(m, keys[i], "inline");
+        assert(NULL != pair && MAP_OK == map_put(m, pair));
+        assert(NULL != (pair = map_pair_create_inline(plain, keys[i], "inline")) && MAP_OK == map_put(plain, pair));
+    }
+    for(i = 0; i < count; i += 3){ //pairs of every kind are released back into the arena
+        struct map_pair *pair = map_pair_create(m);
+        assert(NULL != pair);
+        pair->key = map_strdup(m, keys[i]);
+        pair->value = map_strdup(m, "strdup");
+        assert(MAP_OK == map_set(m, pair)); //releases the inline pair
+        assert(pair == map_get(m, keys[i]) && 0 == strcmp("strdup", pair->value));
+    }
+    for(i = 1; i < count; i += 3){
+        struct map_pair *pair = map_pair_create_inline(m, keys[i], "replaced");
+        map_pair_release(m, map_replace(m, pair));
+        assert(pair == map_get(m, keys[i]) && 0 == strcmp("replaced", pair->value));
+    }
+    for(i = 2; i < count; i += 3){
+        assert(MAP_OK == map_del(m, keys[i]) && NULL == map_get(m, keys[i]));
+    }
+    int busy = ((struct skiplist *)m)->busy;
+    for(i = 2; i < count; i += 3){ //reuses the freed blocks
+        struct map_pair *pair = map_pair_create_inline(m, keys[i], NULL);
+        assert(NULL != pair && MAP_OK == map_put(m, pair) && NULL == pair->value);
+    }
+    assert(count == ((struct skiplist *)m)->busy && busy < count);
+
+    //a tower taller than the list allows is refused, cutting it down would lose the inline key
+    struct map *low = map_create();
+    struct map_pair *tall = NULL;
+    assert(NULL != low);
+    skiplist_init_maxlevel((struct skiplist *)low, ((struct skiplist *)low)->cmp_item, 1);
+    while(NULL != (tall = map_pair_create_inline(m, "tall", "v")) && tall->node.level < 2) map_pair_release(m, tall);
+    assert(NULL != tall && MAP_ERR == map_put(low, tall) && MAP_ERR == map_set(low, tall));
+    assert(tall->node.level >= 2 && 0 == strcmp("tall", tall->key) && 0 == strcmp("v", tall->value));
+    map_pair_release(m, tall);
+    map_free(low);
+    for(i = 0; i < count; i++){
+        assert(NULL != map_get(m, keys[i]) && NULL != map_get(plain, keys[i]));
+        free(keys[i]);
+    }
+    free(keys);
+
+    int64_t start = getCurrentTime();
+    map_free(plain);
+    int64_t plain_time = getCurrentTime() - start;
+    start = getCurrentTime();
+    map_free(m);
+    printf("free time consuming:%ld arena free:%ld count:%d\n", plain_time, getCurrentTime() - start, count);
+}
+
+void image_testing(struct map *m) __attribute__((unused));
+void image_testing(struct map *m) {
+    const char *path = "map_test.img";
+    int64_t start = getCurrentTimeNs();
+    assert(MAP_OK == map_save(m, path));
+    int64_t save_time = getCurrentTimeNs() - start;
+
+    struct skiplist_image img;
+    start = getCurrentTimeNs();
+    assert(MAP_OK == map_image_open(&img, path));
+    int64_t open_time = getCurrentTimeNs() - start;
+    assert(((struct skiplist *)m)->busy == skiplist_image_header(&img)->count);
+
+    //same keys in the same order with the same values, straight from the mapping
+    const struct skiplist_image_node *node = skiplist_image_first(&img);
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){
+        struct map_pair *pair = skiplist_entry(pos, struct map_pair, node);
+        assert(NULL != node && 0 == strcmp(pair->key, skiplist_image_key(node)));
+        const char *value = skiplist_image_value(node);
+        assert(NULL == pair->value ? NULL == value : 0 == strcmp(pair->value, value));
+        assert(value == map_image_get(&img, pair->key));
+        node = skiplist_image_next(&img, node);
+    }
+    assert(NULL == node);
+    assert(NULL == map_image_get(&img, "~missing") && NULL == map_image_get(&img, ""));
+    node = skiplist_image_seek_ge(&img, "test", 5);
+    assert(NULL != node && 0 == strcmp("test", skiplist_image_key(node)));
+    node = skiplist_image_floor(&img, "test", 5, 0);
+    assert(NULL != node && 0 > strcmp(skiplist_image_key(node), "test"));
+
+    //what every process start does without the image
+    start = getCurrentTimeNs();
+    struct map *rebuilt = map_create();
+    assert(NULL != rebuilt);
+    SKIPLIST_IMAGE_FOREACH(&img, node){
+        struct map_pair *pair = map_pair_create_inline(rebuilt, skiplist_image_key(node), skiplist_image_value(node));
+        assert(NULL != pair && MAP_OK == map_put(rebuilt, pair));
+    }
+    int64_t rebuild_time = getCurrentTimeNs() - start;
+    assert(((struct skiplist *)rebuilt)->busy == ((struct skiplist *)m)->busy);
+    map_free(rebuilt);
+    map_image_close(&img);
+    printf("image save:%ldus open:%ldus rebuild:%ldus count:%d\n", save_time / 1000, open_time / 1000,
+            rebuild_time / 1000, ((struct skiplist *)m)->busy);
+
+    //anything else is turned down
+    FILE *file = fopen(path, "r+b");
+    assert(NULL != file && 0 == fseek(file, 0, SEEK_END));
+    assert(0 == ftruncate(fileno(file), ftell(file) - 8));
+    fclose(file);
+    assert(MAP_ERR == map_image_open(&img, path));
+    assert(NULL != (file = fopen(path, "wb")) && 1 == fwrite("not an image", 12, 1, file));
+    fclose(file);
+    assert(MAP_ERR == map_image_open(&img, path));
+    assert(MAP_ERR == map_image_open(&img, "missing/map_test.img"));
+    unlink(path);
+}
+
+void cover_testing(struct map *m) __attribute__((unused));
+void cover_testing(struct map *m) {
+    struct map_pair *old_pair = map_pair_create(m);
+    assert(NULL != (old_pair->key = strdup("test")));
+    assert(NULL != (old_pair->value = strdup("old")));
+
+    struct map_pair *new_pair = map_pair_create(m);
+    assert(NULL != (new_pair->key = strdup("test")));
+    assert(NULL != (new_pair->value = strdup("new")));
+
+    assert(MAP_OK == map_put(m, old_pair));
+    assert(MAP_ERR == map_put(m, new_pair)); //duplicate values are not allowed to be inserted
+    assert(old_pair == map_get(m, (void *)"test"));
+    map_pair_free(new_pair);
+
+    //bounded scans: every key in ["te", "tf") starts with "te" and "test" is among them
+    int count = map_count(m, "te", "tf"), seen = 0, found = 0;
+    struct map_iterator iterator = map_iterator_range(m, "te", "tf");
+    struct map_pair *curr = NULL, *last = NULL;
+    while(NULL != (curr = map_iterator_next(&iterator))){
+        assert(0 == strncmp(curr->key, "te", 2));
+        assert(NULL == last || 0 > strcmp(last->key, curr->key));
+        found |= (curr == old_pair);
+        last = curr;
+        seen += 1;
+    }
+    assert(seen == count && found);
+    assert(map_count(m, NULL, NULL) == ((struct skiplist *)m)->busy);
+    assert(0 == map_count(m, "tf", "te"));
+
+    //rank and select agree with the level 0 order
+    int rank = 0;
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){
+        struct map_pair *pair = skiplist_entry(pos, struct map_pair, node);
+        rank += 1;
+        if(0 == rank % 1000 || old_pair == pair){
+            assert(rank == map_rank(m, pair->key));
+            assert(pair == map_select(m, rank));
+        }
+    }
+    assert(rank == ((struct skiplist *)m)->busy);
+    assert(0 == map_rank(m, (void *)"missing"));
+    assert(NULL == map_select(m, 0) && NULL == map_select(m, rank + 1));
+
+    int n = 0, visited = 0;
+    SKIPLIST_FOREACH_RANK((struct skiplist *)m, pos, n, rank - 9, rank + 5){
+        assert(pos == &map_select(m, n)->node);
+        visited += 1;
+    }
+    assert(10 == visited);
+
+    //upsert and replace keep the rank of the key, whatever the tower heights
+    int busy = ((struct skiplist *)m)->busy;
+    rank = map_rank(m, (void *)"test");
+    struct map_pair *set_pair = map_pair_create(m);
+    assert(NULL != (set_pair->key = strdup("test")));
+    assert(NULL != (set_pair->value = strdup("set")));
+    assert(MAP_OK == map_set(m, set_pair)); //frees old_pair
+    assert(set_pair == map_get(m, (void *)"test") && set_pair == map_select(m, rank));
+
+    struct map_pair *replace_pair = map_pair_create(m);
+    assert(NULL != (replace_pair->key = strdup("test")));
+    assert(NULL != (replace_pair->value = strdup("replaced")));
+    assert(set_pair == map_replace(m, replace_pair));
+    map_pair_free(set_pair);
+    assert(rank == map_rank(m, (void *)"test") && replace_pair == map_select(m, rank));
+    assert(busy == ((struct skiplist *)m)->busy);
+
+    struct map_pair *missing_pair = map_pair_create(m);
+    assert(NULL != (missing_pair->key = strdup("missing")));
+    assert(NULL == map_replace(m, missing_pair)); //not taken
+    assert(MAP_OK == map_set(m, missing_pair)); //inserted
+    assert(busy + 1 == ((struct skiplist *)m)->busy);
+    assert(MAP_OK == map_del(m, (void *)"missing"));
+
+    rank = 0;
+    iter = NULL;
+    SKIPLIST_FOREACH_NEXT((struct skiplist *)m, pos, iter){
+        struct map_pair *pair = skiplist_entry(pos, struct map_pair, node);
+        rank += 1;
+        if(0 == rank % 1000) assert(pair == map_select(m, rank));
+    }
+    assert(busy == rank);
+
+    //keys that tie on the cached prefix or end inside it still sort like strncmp
+    char *tied[] = { "prefix00b", "prefix00", "prefix0", "prefix00a", "prefix00\xff", "prefix0\xff" };
+    int tied_count = sizeof(tied) / sizeof(tied[0]), i = 0;
+    for(; i < tied_count; i++){
+        struct map_pair *pair = map_pair_create(m);
+        assert(NULL != (pair->key = strdup(tied[i])));
+        assert(MAP_OK == map_put(m, pair));
+        assert(pair == map_get(m, tied[i]));
+    }
+    assert(tied_count == map_count(m, "prefix0", "prefix0\xff"));
+    iterator = map_iterator_range(m, "prefix0", "prefix0\xff");
+    last = NULL;
+    while(NULL != (curr = map_iterator_next(&iterator))){
+        assert(NULL == last || 0 > strcmp(last->key, curr->key));
+        last = curr;
+    }
+    for(i = 0; i < tied_count; i++){
+        assert(MAP_OK == map_del(m, tied[i]));
+    }
+}
+
+//values[i] is what key i held when 'snap' was opened, NULL if absent
+static void check_snapshot(struct map *m, struct skiplist_snapshot *snap, char **values, int count){
+    char key[32];
+    int i = 0;
+    for(; i < count; i++){
+        sprintf(key, "mvcc%06d", i);
+        struct map_pair *pair = map_snapshot_get(m, snap, key);
+        assert(NULL == values[i] ? NULL == pair : (NULL != pair && 0 == strcmp(values[i], pair->value)));
+    }
+}
+
+static void mvcc_write(struct map *m, char **values, int count, int ops){
+    char key[32];
+    int i = 0;
+    for(; i < ops; i++){
+        int k = random() % count;
+        sprintf(key, "mvcc%06d", k);
+        if(random() % 4){
+            char *value = random_str(random_range(1, 16));
+            struct map_pair *pair = map_pair_create_inline(m, key, value);
+            assert(NULL != pair && MAP_OK == map_set(m, pair));
+            free(values[k]);
+            values[k] = value;
+        }else{
+            assert((NULL == values[k] ? MAP_ERR : MAP_OK) == map_del(m, key));
+            free(values[k]);
+            values[k] = NULL;
+        }
+    }
+}
+
+static char **mvcc_copy(char **values, int count){
+    char **copy = calloc(count, sizeof(*copy));
+    int i = 0;
+    assert(NULL != copy);
+    for(; i < count; i++){
+        copy[i] = NULL != values[i] ? strdup(values[i]) : NULL;
+    }
+    return copy;
+}
+
+static void mvcc_free(char **values, int count){
+    int i = 0;
+    for(; i < count; i++){
+        free(values[i]);
+    }
+    free(values);
+}
+
+void mvcc_testing(int count) __attribute__((unused));
+void mvcc_testing(int count) {
+    struct map *m = map_create_mvcc();
+    struct skiplist_mvcc *mv = m->mvcc;
+    char **values = calloc(count, sizeof(*values)), key[32];
+    assert(NULL != m && NULL != values);
+    mvcc_write(m, values, count, count * 2);
+    check_snapshot(m, NULL, values, count);
+    assert(0 == mv->garbage); //with no snapshot open old versions go right away
+
+    struct map_pair *pair = map_pair_create_inline(m, "mvcc000000", "dup");
+    assert(NULL != pair);
+    if(NULL != values[0]){
+        assert(MAP_ERR == map_put(m, pair)); //map_put does not shadow a live key
+        map_pair_release(m, pair);
+    }else{
+        assert(MAP_OK == map_put(m, pair));
+        values[0] = strdup("dup");
+    }
+
+    //two snapshots far apart, each keeps its own view while writes go on
+    struct skiplist_snapshot old_snap, new_snap;
+    map_snapshot_open(m, &old_snap);
+    char **old_values = mvcc_copy(values, count);
+    mvcc_write(m, values, count, count);
+    map_snapshot_open(m, &new_snap);
+    char **new_values = mvcc_copy(values, count);
+    mvcc_write(m, values, count, count);
+    assert(mv->garbage > 0);
+    check_snapshot(m, &old_snap, old_values, count);
+    check_snapshot(m, &new_snap, new_values, count);
+    check_snapshot(m, NULL, values, count);
+
+    //a scan of the old view, with the pair under it overwritten, deleted and collected mid-way
+    int i = 0, seen = 0;
+    int64_t start = getCurrentTime();
+    struct map_snapshot_iterator iter = map_snapshot_iterator_range(m, &old_snap, NULL, NULL);
+    for(; i < count; i++){
+        if(NULL == old_values[i]) continue;
+        sprintf(key, "mvcc%06d", i);
+        assert(NULL != (pair = map_snapshot_iterator_next(&iter)));
+        assert(0 == strcmp(key, pair->key) && 0 == strcmp(old_values[i], pair->value));
+        if(0 == seen++ % 64){
+            if(NULL != values[i]) assert(MAP_OK == map_del(m, key));
+            free(values[i]);
+            values[i] = NULL;
+            mvcc_write(m, values, count, 16);
+        }
+        if(0 == seen % 4096){
+            skiplist_mvcc_collect((struct skiplist *)m, mv);
+        }
+    }
+    assert(NULL == map_snapshot_iterator_next(&iter));
+    printf("snapshot scan time consuming:%ld count:%d garbage:%lu\n", getCurrentTime() - start, seen, mv->garbage);
+
+    //bounded scans see the same view
+    char lo[32], hi[32];
+    sprintf(lo, "mvcc%06d", count / 4);
+    sprintf(hi, "mvcc%06d", count / 2);
+    iter = map_snapshot_iterator_range(m, &new_snap, lo, hi);
+    for(i = count / 4; i <= count / 2; i++){
+        if(NULL == new_values[i]) continue;
+        assert(NULL != (pair = map_snapshot_iterator_next(&iter)) && 0 == strcmp(new_values[i], pair->value));
+    }
+    assert(NULL == map_snapshot_iterator_next(&iter));
+
+    //releasing the snapshots lets every shadowed version and tombstone go
+    map_snapshot_release(m, &old_snap);
+    check_snapshot(m, &new_snap, new_values, count);
+    map_snapshot_release(m, &new_snap);
+    skiplist_mvcc_collect((struct skiplist *)m, mv);
+    int live = 0;
+    for(i = 0; i < count; i++){
+        live += NULL != values[i];
+    }
+    assert(0 == mv->garbage && live == ((struct skiplist *)m)->busy);
+    check_snapshot(m, NULL, values, count);
+
+    mvcc_free(old_values, count);
+    mvcc_free(new_values, count);
+    mvcc_free(values, count);
+    map_free(m);
+}
+
+static char *set_key(int i){
+    static char key[32];
+    sprintf(key, "set%07d", i);
+    return key;
+}
+
+static struct map *set_map(char *present, int n, int step){
+    struct map *m = map_create();
+    int i = 0;
+    assert(NULL != m);
+    for(; i < n; i += step){
+        struct map_pair *pair = map_pair_create_inline(m, set_key(i), "v");
+        assert(NULL != pair && MAP_OK == map_put(m, pair));
+        if(NULL != present) present[i] = 1;
+    }
+    return m;
+}
+
+//the map holds exactly the keys i with present[i], in order, and every span still adds up
+static void check_set(struct map *m, char *present, int n){
+    int i = 0, rank = 0;
+    for(; i < n; i++){
+        if(!present[i]){
+            assert(NULL == map_get(m, set_key(i)));
+            continue;
+        }
+        struct map_pair *pair = map_select(m, ++rank);
+        assert(NULL != pair && 0 == strcmp(set_key(i), pair->key) && rank == map_rank(m, pair->key));
+    }
+    assert(rank == ((struct skiplist *)m)->busy && NULL == map_select(m, rank + 1));
+    assert(rank == map_count(m, NULL, NULL));
+    struct skiplist_node *pos, *iter = NULL;
+    int back = 0;
+    SKIPLIST_FOREACH_PREV((struct skiplist *)m, pos, iter){ //the backward links mirror the forward ones
+        assert(pos->link[0].next->prev == pos);
+        back += 1;
+    }
+    assert(rank == back);
+}
+
+void set_testing(int n) __attribute__((unused));
+void set_testing(int n) {
+    char *a_keys = calloc(n, 1), *b_keys = calloc(n, 1), *out_keys = calloc(n, 1);
+    assert(NULL != a_keys && NULL != b_keys && NULL != out_keys);
+    struct map *a = set_map(a_keys, n, 2), *b = set_map(b_keys, n, 3), *out = map_create();
+    int i = 0, count = 0;
+    assert(NULL != out);
+
+    //split at a key that is absent, then join back
+    int64_t start = getCurrentTimeNs();
+    assert(MAP_OK == map_split(a, set_key(n / 3 | 1), out));
+    int64_t split_time = getCurrentTimeNs() - start;
+    for(i = n / 3; i < n; i++){
+        out_keys[i] = a_keys[i];
+        a_keys[i] = 0;
+    }
+    check_set(a, a_keys, n);
+    check_set(out, out_keys, n);
+    assert(MAP_ERR == map_join(out, a)); //'a' lies below 'out'
+    start = getCurrentTimeNs();
+    assert(MAP_OK == map_join(a, out));
+    int64_t join_time = getCurrentTimeNs() - start;
+    for(i = 0; i < n; i++){
+        a_keys[i] |= out_keys[i];
+        out_keys[i] = 0;
+    }
+    check_set(a, a_keys, n);
+    check_set(out, out_keys, n);
+    struct map_pair *pair = map_pair_create_inline(a, set_key(1), "after"); //spans stay right for later puts
+    assert(NULL != pair && MAP_OK == map_put(a, pair));
+    a_keys[1] = 1;
+    check_set(a, a_keys, n);
+
+    //empty cuts at either end
+    assert(MAP_OK == map_split(a, set_key(n), out) && 0 == ((struct skiplist *)out)->busy);
+    assert(MAP_OK == map_split(a, set_key(0), out) && 0 == ((struct skiplist *)a)->busy);
+    assert(MAP_OK == map_join(a, out) && 0 == ((struct skiplist *)out)->busy);
+    check_set(a, a_keys, n);
+
+    //range deletes, bounded and open
+    char lo[32];
+    strcpy(lo, set_key(n / 4));
+    start = getCurrentTimeNs();
+    count = map_range_delete(a, lo, set_key(n / 2));
+    int64_t range_time = getCurrentTimeNs() - start;
+    for(i = n / 4; i <= n / 2; i++){
+        count -= a_keys[i];
+        a_keys[i] = 0;
+    }
+    assert(0 == count);
+    check_set(a, a_keys, n);
+    count = map_range_delete(a, set_key(n - n / 10), NULL);
+    for(i = n - n / 10; i < n; i++){
+        count -= a_keys[i];
+        a_keys[i] = 0;
+    }
+    assert(0 == count && 0 == map_range_delete(a, set_key(n / 2), set_key(n / 4)));
+    check_set(a, a_keys, n);
+
+    //union: 'b' keeps the keys 'a' already had
+    assert(MAP_OK == map_union(a, b));
+    for(i = 0; i < n; i++){
+        if(b_keys[i] && !a_keys[i]){
+            a_keys[i] = 1;
+            b_keys[i] = 0;
+        }
+    }
+    check_set(a, a_keys, n);
+    check_set(b, b_keys, n);
+
+    //intersect with multiples of 5, subtract multiples of 7
+    struct map *c = set_map(NULL, n, 5), *d = set_map(NULL, n, 7);
+    count = map_intersect(a, c);
+    for(i = 0; i < n; i++){
+        if(a_keys[i] && 0 != i % 5){
+            a_keys[i] = 0;
+            count -= 1;
+        }
+    }
+    assert(0 == count);
+    check_set(a, a_keys, n);
+    count = map_subtract(a, d);
+    for(i = 0; i < n; i += 7){
+        count -= a_keys[i];
+        a_keys[i] = 0;
+    }
+    assert(0 == count);
+    check_set(a, a_keys, n);
+
+    //the same cut made pair by pair, for scale
+    struct map *e = set_map(NULL, n, 1), *f = map_create();
+    assert(NULL != f);
+    start = getCurrentTimeNs();
+    for(i = n / 2; i < n; i++){
+        struct map_pair *moved = map_pair_create_inline(f, set_key(i), "v");
+        assert(NULL != moved && MAP_OK == map_put(f, moved) && MAP_OK == map_del(e, set_key(i)));
+    }
+    printf("split ns:%ld join ns:%ld range delete ns:%ld (%d keys), pair by pair ns:%ld\n", (long)split_time,
+            (long)join_time, (long)range_time, n, (long)(getCurrentTimeNs() - start));
+
+    map_free(a);
+    map_free(b);
+    map_free(c);
+    map_free(d);
+    map_free(e);
+    map_free(f);
+    map_free(out);
+    free(a_keys);
+    free(b_keys);
+    free(out_keys);
+}
+
+void index_testing(int count) __attribute__((unused));
+void index_testing(int count) {
+    struct map *m = map_create(), *plain = map_create();
+    char **keys = calloc(count, sizeof(*keys));
+    assert(NULL != m && NULL != plain && NULL != keys);
+    int i = 0;
+    for(; i < count; i++){
+        assert(NULL != (keys[i] = random_str(MAP_MAX_KEY_LEN)));
+        struct map_pair *pair = map_pair_create_inline(plain, keys[i], keys[i]);
+        assert(NULL != pair && MAP_OK == map_put(plain, pair));
+        if(count / 2 == i){ //half indexed at once, the rest through puts and incremental resizes
+            assert(MAP_OK == map_index(m) && MAP_ERR == map_index(m));
+        }
+        pair = map_pair_create_inline(m, keys[i], keys[i]);
+        assert(NULL != pair && MAP_OK == map_put(m, pair));
+    }
+    for(i = 0; i < count; i++){
+        struct map_pair *pair = map_get(m, keys[i]);
+        assert(NULL != pair && 0 == strcmp(keys[i], pair->value));
+    }
+
+    int64_t start = getCurrentTime();
+    for(i = 0; i < count; i++){
+        assert(NULL != map_get(plain, keys[i]));
+    }
+    int64_t plain_time = getCurrentTime() - start;
+    start = getCurrentTime();
+    for(i = 0; i < count; i++){
+        assert(NULL != map_get(m, keys[i]));
+    }
+    printf("get time consuming:%ld indexed:%ld count:%d\n", plain_time, getCurrentTime() - start, count);
+
+    //every path that links, swaps or unlinks keeps the index in step
+    struct map_pair *dup = map_pair_create_inline(m, keys[0], "dup");
+    assert(NULL != dup && MAP_ERR == map_put(m, dup));
+    map_pair_release(m, dup);
+    assert(NULL == map_get(m, "~missing") && MAP_ERR == map_del(m, "~missing"));
+    for(i = 0; i < count; i += 4){
+        struct map_pair *pair = map_pair_create_inline(m, keys[i], "set");
+        assert(NULL != pair && MAP_OK == map_set(m, pair) && pair == map_get(m, keys[i]));
+    }
+    for(i = 1; i < count; i += 4){
+        struct map_pair *pair = map_pair_create_inline(m, keys[i], "replaced");
+        map_pair_release(m, map_replace(m, pair));
+        assert(pair == map_get(m, keys[i]));
+    }
+    for(i = 2; i < count; i += 4){
+        assert(MAP_OK == map_del(m, keys[i]) && NULL == map_get(m, keys[i]) && MAP_ERR == map_del(m, keys[i]));
+    }
+    struct map_pair *pair = map_pair_create_inline(m, "~new", "set"); //map_set of a new key
+    assert(NULL != pair && MAP_OK == map_set(m, pair) && pair == map_get(m, "~new"));
+    struct map_pair *loaded[2] = { map_pair_create_inline(m, "~~load1", "l"), map_pair_create_inline(m, "~~load2", "l") };
+    assert(MAP_OK == map_load(m, loaded, 2) && loaded[1] == map_get(m, "~~load2"));
+    int deleted = map_range_delete(m, "~", NULL);
+    assert(3 == deleted && NULL == map_get(m, "~new") && NULL == map_get(m, "~~load1"));
+    struct map *other = map_create();
+    assert(NULL != other && MAP_ERR == map_join(m, other));
+    map_free(other);
+    for(i = 0; i < count; i++){
+        pair = map_get(m, keys[i]);
+        assert((2 == i % 4) == (NULL == pair));
+        assert(NULL == pair || 0 == strcmp(keys[i], pair->key));
+    }
+    assert(count - (count + 1) / 4 == ((struct skiplist *)m)->busy);
+
+    for(i = 0; i < count; i++){
+        free(keys[i]);
+    }
+    free(keys);
+    map_free(m);
+    map_free(plain);
+}
+
+int main(){
+    struct map *m = map_create();
+
+    stress_testing(m, MAP_MAX_KEY_LEN, 100000);
+    batch_testing(m);
+    cover_testing(m);
+    bulk_testing(100000);
+    arena_testing(100000);
+    image_testing(m);
+    mvcc_testing(50000);
+    set_testing(100000);
+    index_testing(200000);
+
+    int i = 0;
+    struct map_iterator iterator = map_iterator_begin(m, "test");
+    struct map_pair *curr = NULL;
+    while(NULL != (curr = map_iterator_next(&iterator))){
+        printf("key:%s value:%s\n", curr->key, curr->value);
+        assert(MAP_OK == map_del(m, curr->key));
+        if(++i >= 10){
+            break;
+        }
+    }
+
+    assert(1 == map_rank(m, map_select(m, 1)->key)); //spans survive deletes
+
+    //free
+    printf("map size before free:%d\n", ((struct skiplist *)m)->busy);
+    map_free(m);
+
+    printf("over\n");
+    return 0;
+}
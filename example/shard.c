@@ -0,0 +1,462 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "map.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// thread pool
+///////////////////////////////////////////////////////////////////////////////
+#define POOL_MAX_TASKS 256
+
+typedef void pool_task_fn(void *arg);
+
+struct pool_task{
+    pool_task_fn *fn;
+    void *arg;
+};
+
+struct pool{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+    int head;
+    int tail;
+    struct pool_task tasks[POOL_MAX_TASKS];
+    int nthreads;
+    pthread_t *threads;
+};
+
+static void *pool_run(void *arg){
+    struct pool *p = arg;
+    for(;;){
+        pthread_mutex_lock(&p->lock);
+        while(!p->stop && p->head == p->tail)
+            pthread_cond_wait(&p->cond, &p->lock);
+        if(p->head == p->tail){ //stopped and drained
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        struct pool_task task = p->tasks[p->head++ % POOL_MAX_TASKS];
+        pthread_cond_broadcast(&p->cond); //a slot is free for pool_submit
+        pthread_mutex_unlock(&p->lock);
+        task.fn(task.arg);
+    }
+}
+
+static void pool_free(struct pool *p){
+    if(NULL == p) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    int i = 0;
+    for(; i < p->nthreads; i++){
+        pthread_join(p->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    free(p->threads);
+    free(p);
+}
+
+static struct pool *pool_create(int nthreads){
+    struct pool *p = calloc(1, sizeof(*p));
+    if(NULL == p) goto err;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    if(NULL == (p->threads = calloc(nthreads, sizeof(pthread_t)))) goto err;
+    for(; p->nthreads < nthreads; p->nthreads++){
+        if(0 != pthread_create(&p->threads[p->nthreads], NULL, pool_run, p)) goto err;
+    }
+    return p;
+
+err:
+    pool_free(p);
+    return NULL;
+}
+
+static void pool_submit(struct pool *p, pool_task_fn *fn, void *arg){
+    pthread_mutex_lock(&p->lock);
+    while(p->tail - p->head >= POOL_MAX_TASKS)
+        pthread_cond_wait(&p->cond, &p->lock);
+    p->tasks[p->tail++ % POOL_MAX_TASKS] = (struct pool_task){ .fn = fn, .arg = arg };
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sharded map
+///////////////////////////////////////////////////////////////////////////////
+#define SHARD_MAX 64
+
+struct shard{
+    pthread_mutex_t lock;
+    struct map *m; //its skiplist busy is the per-shard counter
+};
+
+struct shard_map{
+    int count;
+    char **bounds; //NULL: hash partitioning; else count-1 ascending split keys, shard i holds keys < bounds[i]
+    struct pool *pool;
+    struct shard shards[SHARD_MAX];
+};
+
+static unsigned int shard_hash(const char *key){ //FNV-1a
+    unsigned int h = 2166136261u;
+    int i = 0;
+    for(; i < MAP_MAX_KEY_LEN && '\0' != key[i]; i++){
+        h = (h ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return h;
+}
+
+static struct shard *shard_of(struct shard_map *sm, const char *key){
+    if(NULL == sm->bounds){
+        return &sm->shards[shard_hash(key) % sm->count];
+    }
+    int lo = 0, hi = sm->count - 1; //first bound above the key
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(0 > strncmp(key, sm->bounds[mid], MAP_MAX_KEY_LEN)) hi = mid;
+        else lo = mid + 1;
+    }
+    return &sm->shards[lo];
+}
+
+void shard_map_free(struct shard_map *sm){
+    if(NULL == sm) return;
+    pool_free(sm->pool);
+    int i = 0;
+    for(; i < sm->count; i++){
+        map_free(sm->shards[i].m);
+        pthread_mutex_destroy(&sm->shards[i].lock);
+    }
+    free(sm);
+}
+
+//'bounds' (count-1 ascending keys, kept by reference) selects range partitioning, NULL hashes keys
+struct shard_map *shard_map_create(int count, char **bounds, int scan_threads){
+    if(count < 1 || count > SHARD_MAX) return NULL;
+    struct shard_map *sm = calloc(1, sizeof(*sm));
+    if(NULL == sm) goto err;
+    sm->bounds = bounds;
+    for(; sm->count < count; sm->count++){
+        pthread_mutex_init(&sm->shards[sm->count].lock, NULL);
+        if(NULL == (sm->shards[sm->count].m = map_create())) goto err;
+    }
+    if(NULL == (sm->pool = pool_create(scan_threads > 0 ? scan_threads : 1))) goto err;
+    return sm;
+
+err:
+    shard_map_free(sm);
+    return NULL;
+}
+
+struct map_pair *shard_map_pair_create(struct shard_map *sm){
+    //workers call this unlocked, so the tower comes from the per-thread generator, not a shard's own
+    int maxlevel = ((struct skiplist *)sm->shards[0].m)->maxlevel; //every shard shares the same max level
+    return SKIPLIST_NODE_ALLOC_LEVEL(struct map_pair, node, SKIPLIST_RANDOM_LEVEL(maxlevel));
+}
+
+int shard_map_put(struct shard_map *sm, struct map_pair *pair){
+    struct shard *s = shard_of(sm, pair->key);
+    pthread_mutex_lock(&s->lock);
+    int res = map_put(s->m, pair);
+    pthread_mutex_unlock(&s->lock);
+    return res;
+}
+
+//copies at most 'len' bytes of the value out under the shard lock, MAP_ERR if absent. A pair with a
+//NULL value is present and copies out as an empty string
+int shard_map_get(struct shard_map *sm, char *key, char *value, int len){
+    struct shard *s = shard_of(sm, key);
+    pthread_mutex_lock(&s->lock);
+    struct map_pair *pair = map_get(s->m, key);
+    if(NULL != pair && len > 0){
+        strncpy(value, NULL != pair->value ? pair->value : "", len - 1);
+        value[len - 1] = '\0';
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL != pair ? MAP_OK : MAP_ERR;
+}
+
+int shard_map_del(struct shard_map *sm, char *key){
+    struct shard *s = shard_of(sm, key);
+    pthread_mutex_lock(&s->lock);
+    int res = map_del(s->m, key);
+    pthread_mutex_unlock(&s->lock);
+    return res;
+}
+
+int shard_map_busy(struct shard_map *sm){
+    int busy = 0, i = 0;
+    for(; i < sm->count; i++){
+        pthread_mutex_lock(&sm->shards[i].lock);
+        busy += ((struct skiplist *)sm->shards[i].m)->busy;
+        pthread_mutex_unlock(&sm->shards[i].lock);
+    }
+    return busy;
+}
+
+//ordered k-way merge over every shard, all shards stay locked until shard_map_iterator_end
+struct shard_map_iterator{
+    struct shard_map *sm;
+    int n;                                 //live entries in heap
+    int heap[SHARD_MAX];                   //shard indexes, min-heap on their head key
+    struct map_pair *heads[SHARD_MAX];
+    struct map_iterator iters[SHARD_MAX];
+};
+
+static int shard_heap_less(struct shard_map_iterator *it, int a, int b){
+    return 0 > strncmp(it->heads[it->heap[a]]->key, it->heads[it->heap[b]]->key, MAP_MAX_KEY_LEN);
+}
+
+static void shard_heap_down(struct shard_map_iterator *it, int i){
+    for(;;){
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if(l < it->n && shard_heap_less(it, l, min)) min = l;
+        if(r < it->n && shard_heap_less(it, r, min)) min = r;
+        if(min == i) return;
+        int tmp = it->heap[i];
+        it->heap[i] = it->heap[min];
+        it->heap[min] = tmp;
+        i = min;
+    }
+}
+
+void shard_map_iterator_begin(struct shard_map *sm, struct shard_map_iterator *it, char *lo, char *hi){
+    it->sm = sm;
+    it->n = 0;
+    int i = 0;
+    for(; i < sm->count; i++){ //always in index order, so concurrent iterators cannot deadlock
+        pthread_mutex_lock(&sm->shards[i].lock);
+        it->iters[i] = map_iterator_range(sm->shards[i].m, lo, hi);
+        if(NULL != (it->heads[i] = map_iterator_next(&it->iters[i]))){
+            it->heap[it->n++] = i;
+        }
+    }
+    for(i = it->n / 2 - 1; i >= 0; i--){
+        shard_heap_down(it, i);
+    }
+}
+
+struct map_pair *shard_map_iterator_next(struct shard_map_iterator *it){
+    if(0 == it->n) return NULL;
+    int top = it->heap[0];
+    struct map_pair *res = it->heads[top];
+    if(NULL == (it->heads[top] = map_iterator_next(&it->iters[top]))){
+        it->heap[0] = it->heap[--it->n];
+    }
+    shard_heap_down(it, 0);
+    return res;
+}
+
+void shard_map_iterator_end(struct shard_map_iterator *it){
+    int i = it->sm->count - 1;
+    for(; i >= 0; i--){
+        pthread_mutex_unlock(&it->sm->shards[i].lock);
+    }
+}
+
+//parallel scan: every shard's part of ['lo', 'hi'] is visited on the pool, unordered across shards
+typedef void shard_scan_fn(struct map_pair *pair, int shard, void *arg);
+
+struct shard_scan{
+    struct shard_map *sm;
+    char *lo;
+    char *hi;
+    shard_scan_fn *fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+    int visited;
+};
+
+struct shard_scan_task{
+    struct shard_scan *scan;
+    int shard;
+};
+
+static void shard_scan_run(void *arg){
+    struct shard_scan_task *task = arg;
+    struct shard_scan *scan = task->scan;
+    struct shard *s = &scan->sm->shards[task->shard];
+    int visited = 0;
+    pthread_mutex_lock(&s->lock);
+    struct map_iterator iterator = map_iterator_range(s->m, scan->lo, scan->hi);
+    struct map_pair *curr = NULL;
+    while(NULL != (curr = map_iterator_next(&iterator))){
+        scan->fn(curr, task->shard, scan->arg);
+        visited += 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    pthread_mutex_lock(&scan->lock);
+    scan->visited += visited;
+    if(0 == --scan->pending)
+        pthread_cond_signal(&scan->cond);
+    pthread_mutex_unlock(&scan->lock);
+}
+
+//returns the number of pairs visited
+int shard_map_scan(struct shard_map *sm, char *lo, char *hi, shard_scan_fn *fn, void *arg){
+    struct shard_scan scan = { .sm = sm, .lo = lo, .hi = hi, .fn = fn, .arg = arg, .pending = sm->count, .visited = 0 };
+    struct shard_scan_task tasks[SHARD_MAX];
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.cond, NULL);
+    int i = 0;
+    for(; i < sm->count; i++){
+        tasks[i] = (struct shard_scan_task){ .scan = &scan, .shard = i };
+        pool_submit(sm->pool, shard_scan_run, &tasks[i]);
+    }
+    pthread_mutex_lock(&scan.lock);
+    while(scan.pending > 0)
+        pthread_cond_wait(&scan.cond, &scan.lock);
+    pthread_mutex_unlock(&scan.lock);
+    pthread_mutex_destroy(&scan.lock);
+    pthread_cond_destroy(&scan.cond);
+    return scan.visited;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test
+///////////////////////////////////////////////////////////////////////////////
+struct insert_worker{
+    struct shard_map *sm;
+    int count;
+    unsigned int seed;
+    pthread_t tid;
+};
+
+static void *insert_run(void *arg){
+    struct insert_worker *w = arg;
+    int i = 0;
+    for(; i < w->count; i++){
+        struct map_pair *pair = shard_map_pair_create(w->sm);
+        assert(NULL != pair);
+        assert(NULL != (pair->key = malloc(MAP_MAX_KEY_LEN + 1)));
+        int j = 0;
+        for(; j < MAP_MAX_KEY_LEN; j++){
+            pair->key[j] = 'a' + rand_r(&w->seed) % 26;
+        }
+        pair->key[j] = '\0';
+        assert(NULL != (pair->value = strdup(pair->key)));
+        if(MAP_OK != shard_map_put(w->sm, pair))
+            map_pair_free(pair);
+    }
+    return NULL;
+}
+
+void stress_testing(int shards, int threads, int count) __attribute__((unused));
+void stress_testing(int shards, int threads, int count) {
+    struct shard_map *sm = shard_map_create(shards, NULL, 1);
+    assert(NULL != sm);
+    struct insert_worker workers[64];
+    int64_t start = getCurrentTime();
+    int i = 0;
+    for(; i < threads; i++){
+        workers[i] = (struct insert_worker){ .sm = sm, .count = count / threads, .seed = i + 1 };
+        assert(0 == pthread_create(&workers[i].tid, NULL, insert_run, &workers[i]));
+    }
+    for(i = 0; i < threads; i++){
+        pthread_join(workers[i].tid, NULL);
+    }
+    printf("time consuming:%ld shards:%d threads:%d count:%d\n", getCurrentTime() - start, shards, threads, shard_map_busy(sm));
+    shard_map_free(sm);
+}
+
+static void count_scan(struct map_pair *pair, int shard, void *arg){
+    __atomic_add_fetch((int *)arg, 1, __ATOMIC_RELAXED);
+}
+
+void cover_testing(struct shard_map *sm) __attribute__((unused));
+void cover_testing(struct shard_map *sm) {
+    int i = 0;
+    for(; i < 10000; i++){
+        struct map_pair *pair = shard_map_pair_create(sm);
+        assert(NULL != pair);
+        assert(NULL != (pair->key = random_str(8)));
+        assert(NULL != (pair->value = strdup(pair->key)));
+        if(MAP_OK != shard_map_put(sm, pair))
+            map_pair_free(pair);
+    }
+    int busy = shard_map_busy(sm);
+
+    //the merge iterator yields every key once, in order
+    struct shard_map_iterator it;
+    struct map_pair *curr = NULL;
+    char last[MAP_MAX_KEY_LEN + 1] = "";
+    int seen = 0;
+    shard_map_iterator_begin(sm, &it, NULL, NULL);
+    while(NULL != (curr = shard_map_iterator_next(&it))){
+        assert(0 < strncmp(curr->key, last, MAP_MAX_KEY_LEN));
+        strcpy(last, curr->key);
+        seen += 1;
+    }
+    shard_map_iterator_end(&it);
+    assert(seen == busy);
+
+    //bounded merge and parallel scan agree
+    int scanned = 0;
+    seen = 0;
+    shard_map_iterator_begin(sm, &it, "A", "M");
+    while(NULL != (curr = shard_map_iterator_next(&it))){
+        assert(0 <= strcmp(curr->key, "A") && 0 >= strcmp(curr->key, "M"));
+        seen += 1;
+    }
+    shard_map_iterator_end(&it);
+    assert(seen == shard_map_scan(sm, "A", "M", count_scan, &scanned) && seen == scanned);
+
+    char value[MAP_MAX_KEY_LEN + 1];
+    assert(MAP_OK == shard_map_get(sm, last, value, sizeof(value)) && 0 == strcmp(value, last));
+    assert(MAP_OK == shard_map_del(sm, last));
+    assert(MAP_ERR == shard_map_get(sm, last, value, sizeof(value)));
+    assert(busy - 1 == shard_map_busy(sm));
+
+    struct map_pair *pair = shard_map_pair_create(sm); //a NULL value is present, and empty
+    assert(NULL != pair && NULL != (pair->key = strdup(last)));
+    assert(MAP_OK == shard_map_put(sm, pair) && MAP_OK == shard_map_get(sm, last, value, sizeof(value)) && '\0' == value[0]);
+}
+
+int main(){
+    char *bounds[] = { "J", "S", "d", "m", "v" };
+    struct shard_map *hashed = shard_map_create(8, NULL, 4);
+    struct shard_map *ranged = shard_map_create(6, bounds, 4);
+    assert(NULL != hashed && NULL != ranged);
+    cover_testing(hashed);
+    cover_testing(ranged);
+    shard_map_free(hashed);
+    shard_map_free(ranged);
+
+    int threads = 1;
+    for(; threads <= 8; threads *= 2){
+        stress_testing(1, threads, 200000);
+        stress_testing(16, threads, 200000);
+    }
+
+    printf("over\n");
+    return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//SKIPLIST_DEFINE against the function pointer calls, same items and same order for both
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "skiplist.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// int keys
+///////////////////////////////////////////////////////////////////////////////
+struct int_item{
+    int key;
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+#define INT_ITEM_CMP(i, j) (((i)->key > (j)->key) - ((i)->key < (j)->key))
+
+static int int_item_cmp(void *k1, void *k2){
+    struct int_item *i = skiplist_entry(k1, struct int_item, node), *j = skiplist_entry(k2, struct int_item, node);
+    return INT_ITEM_CMP(i, j);
+}
+
+SKIPLIST_DEFINE(int_list, struct int_item, node, INT_ITEM_CMP)
+
+///////////////////////////////////////////////////////////////////////////////
+// string keys
+///////////////////////////////////////////////////////////////////////////////
+#define STR_KEY_LEN 16
+
+struct str_item{
+    char *key;
+    struct skiplist_node node;
+};
+
+static inline int str_item_cmp_inline(struct str_item *i, struct str_item *j){
+    return strcmp(i->key, j->key);
+}
+
+static int str_item_cmp(void *k1, void *k2){
+    return str_item_cmp_inline(skiplist_entry(k1, struct str_item, node), skiplist_entry(k2, struct str_item, node));
+}
+
+SKIPLIST_DEFINE(str_list, struct str_item, node, str_item_cmp_inline)
+
+///////////////////////////////////////////////////////////////////////////////
+// benchmark
+///////////////////////////////////////////////////////////////////////////////
+//the saved call per step is a few ns, so each timing is the best of BENCH_REPEAT runs with the two
+//front ends taking turns; small lists stay in cache, where the compare is a real share of the step
+#define BENCH_OPS 500000
+#define BENCH_REPEAT 7
+
+enum{ BENCH_GENERIC_PUT, BENCH_DEFINED_PUT, BENCH_GENERIC_GET, BENCH_DEFINED_GET, BENCH_TIMINGS };
+
+static void bench_keep(int64_t *best, int which, int64_t start){
+    int64_t elapsed = getCurrentTimeNs() - start;
+    if(elapsed < best[which]) best[which] = elapsed;
+}
+
+static void print_row(const char *name, int n, int ops, int64_t *best){
+    printf("%-8s %-6s %10d %12.1f %12.1f %8.2fx\n", name, "put", n, (double)best[BENCH_GENERIC_PUT] / ops,
+            (double)best[BENCH_DEFINED_PUT] / ops, (double)best[BENCH_GENERIC_PUT] / best[BENCH_DEFINED_PUT]);
+    printf("%-8s %-6s %10d %12.1f %12.1f %8.2fx\n", name, "get", n, (double)best[BENCH_GENERIC_GET] / ops,
+            (double)best[BENCH_DEFINED_GET] / ops, (double)best[BENCH_GENERIC_GET] / best[BENCH_DEFINED_GET]);
+}
+
+//both lists get their own copy of every item with the same tower, so they end up with the same shape
+static void int_bench(int n){
+    struct int_item **generic_items = malloc(sizeof(*generic_items) * n), **defined_items = malloc(sizeof(*defined_items) * n);
+    int *probes = malloc(sizeof(*probes) * n);
+    struct skiplist generic, defined;
+    int64_t best[BENCH_TIMINGS], start = 0;
+    assert(NULL != generic_items && NULL != defined_items && NULL != probes);
+    skiplist_init(&generic, int_item_cmp); //sizes the towers
+    int i = 0, round = 0, repeat = 0, found = 0;
+    for(; i < n; i++){
+        assert(NULL != (generic_items[i] = SKIPLIST_NODE_ALLOC(&generic, struct int_item, node)));
+        assert(NULL != (defined_items[i] = SKIPLIST_NODE_ALLOC_LEVEL(struct int_item, node, generic_items[i]->node.level)));
+        generic_items[i]->key = defined_items[i]->key = (int)random();
+    }
+    for(i = 0; i < n; i++) probes[i] = generic_items[(i * 7919L) % n]->key; //no item reads besides the search
+    for(i = 0; i < BENCH_TIMINGS; i++) best[i] = INT64_MAX;
+    int rounds = (BENCH_OPS + n - 1) / n;
+    for(; repeat < BENCH_REPEAT; repeat++){
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){ //rebuilt from scratch, init drops the old links
+            skiplist_init(&generic, int_item_cmp);
+            for(i = 0; i < n; i++) skiplist_put(&generic, &generic_items[i]->node);
+        }
+        bench_keep(best, BENCH_GENERIC_PUT, start);
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){
+            int_list_init(&defined);
+            for(i = 0; i < n; i++) int_list_put(&defined, defined_items[i]);
+        }
+        bench_keep(best, BENCH_DEFINED_PUT, start);
+
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){
+            for(i = 0; i < n; i++){
+                struct int_item probe = { .key = probes[i] };
+                found += NULL != skiplist_get(&generic, &probe.node);
+            }
+        }
+        bench_keep(best, BENCH_GENERIC_GET, start);
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){
+            for(i = 0; i < n; i++){
+                struct int_item probe = { .key = probes[i] };
+                found -= NULL != int_list_get(&defined, &probe);
+            }
+        }
+        bench_keep(best, BENCH_DEFINED_GET, start);
+    }
+    assert(0 == found);
+
+    print_row("int", n, rounds * n, best);
+    for(i = 0; i < n; i++){
+        free(generic_items[i]);
+        free(defined_items[i]);
+    }
+    free(generic_items);
+    free(defined_items);
+    free(probes);
+}
+
+static void str_bench(int n){
+    struct str_item **generic_items = malloc(sizeof(*generic_items) * n), **defined_items = malloc(sizeof(*defined_items) * n);
+    char **probes = malloc(sizeof(*probes) * n);
+    struct skiplist generic, defined;
+    int64_t best[BENCH_TIMINGS], start = 0;
+    assert(NULL != generic_items && NULL != defined_items && NULL != probes);
+    skiplist_init(&generic, str_item_cmp);
+    int i = 0, round = 0, repeat = 0, found = 0;
+    for(; i < n; i++){
+        assert(NULL != (generic_items[i] = SKIPLIST_NODE_ALLOC(&generic, struct str_item, node)));
+        assert(NULL != (defined_items[i] = SKIPLIST_NODE_ALLOC_LEVEL(struct str_item, node, generic_items[i]->node.level)));
+        assert(NULL != (generic_items[i]->key = random_str(STR_KEY_LEN)));
+        defined_items[i]->key = generic_items[i]->key; //shared, freed once
+    }
+    for(i = 0; i < n; i++) probes[i] = generic_items[(i * 7919L) % n]->key;
+    for(i = 0; i < BENCH_TIMINGS; i++) best[i] = INT64_MAX;
+    int rounds = (BENCH_OPS + n - 1) / n;
+    for(; repeat < BENCH_REPEAT; repeat++){
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){ //rebuilt from scratch, init drops the old links
+            skiplist_init(&generic, str_item_cmp);
+            for(i = 0; i < n; i++) skiplist_put(&generic, &generic_items[i]->node);
+        }
+        bench_keep(best, BENCH_GENERIC_PUT, start);
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){
+            str_list_init(&defined);
+            for(i = 0; i < n; i++) str_list_put(&defined, defined_items[i]);
+        }
+        bench_keep(best, BENCH_DEFINED_PUT, start);
+
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){
+            for(i = 0; i < n; i++){
+                struct str_item probe = { .key = probes[i] };
+                found += NULL != skiplist_get(&generic, &probe.node);
+            }
+        }
+        bench_keep(best, BENCH_GENERIC_GET, start);
+        start = getCurrentTimeNs();
+        for(round = 0; round < rounds; round++){
+            for(i = 0; i < n; i++){
+                struct str_item probe = { .key = probes[i] };
+                found -= NULL != str_list_get(&defined, &probe);
+            }
+        }
+        bench_keep(best, BENCH_DEFINED_GET, start);
+    }
+    assert(0 == found);
+
+    print_row("string", n, rounds * n, best);
+    for(i = 0; i < n; i++){
+        free(generic_items[i]->key);
+        free(generic_items[i]);
+        free(defined_items[i]);
+    }
+    free(generic_items);
+    free(defined_items);
+    free(probes);
+}
+
+void cover_testing(int n) __attribute__((unused));
+void cover_testing(int n){
+    struct skiplist sl;
+    int_list_init(&sl);
+    int i = 0;
+    for(; i < n; i++){
+        struct int_item *item = SKIPLIST_NODE_ALLOC(&sl, struct int_item, node);
+        assert(NULL != item);
+        item->key = i * 2;
+        assert(SKIPLIST_OK == int_list_put(&sl, item));
+    }
+    struct int_item probe = { .key = 10 }, *old_item = NULL;
+    assert(10 == int_list_get(&sl, &probe)->key);
+    assert(6 == skiplist_rank(&sl, &probe.node)); //generic calls work on the same list
+    probe.key = 11;
+    assert(NULL == int_list_get(&sl, &probe));
+    assert(12 == int_list_seek_ge(&sl, &probe)->key && 12 == int_list_seek_gt(&sl, &probe)->key);
+    assert(10 == int_list_seek_le(&sl, &probe)->key && 10 == int_list_seek_lt(&sl, &probe)->key);
+    probe.key = 12;
+    assert(12 == int_list_seek_ge(&sl, &probe)->key && 14 == int_list_seek_gt(&sl, &probe)->key);
+    assert(12 == int_list_seek_le(&sl, &probe)->key && 10 == int_list_seek_lt(&sl, &probe)->key);
+    probe.key = -1;
+    assert(NULL == int_list_seek_lt(&sl, &probe));
+
+    struct int_item *item = SKIPLIST_NODE_ALLOC(&sl, struct int_item, node);
+    assert(NULL != item);
+    item->key = 12;
+    assert(SKIPLIST_ERR == int_list_put(&sl, item));
+    assert(SKIPLIST_OK == int_list_upsert(&sl, item, &old_item) && NULL != old_item && item != old_item);
+    free(old_item);
+    probe.key = 12;
+    assert(item == int_list_remove(&sl, &probe) && NULL == int_list_remove(&sl, &probe));
+    free(item);
+    assert(n - 1 == sl.busy);
+
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT(&sl, pos, iter){
+        free(skiplist_entry(pos, struct int_item, node));
+    }
+}
+
+int main(int argc, char **argv){
+    int max_items = argc > 1 ? atoi(argv[1]) : 10000; //past that the towers miss the cache and hide the compare
+    cover_testing(1000);
+
+    printf("%-8s %-6s %10s %12s %12s %9s\n", "keys", "op", "items", "ptr ns/op", "define ns/op", "speedup");
+    int n = 100;
+    for(; n <= max_items; n *= 10){
+        int_bench(n);
+        str_bench(n);
+    }
+
+    printf("over\n");
+    return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//built with -DSKIPLIST_SWMR: one writer thread mutates the list, readers never take a lock
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "skiplist.h"
+#include "skiplist_epoch.h"
+
+#ifndef SKIPLIST_SWMR
+#error "build with -DSKIPLIST_SWMR"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// int map with deferred frees
+///////////////////////////////////////////////////////////////////////////////
+struct item{
+    int key;
+    int value;
+    struct skiplist_epoch_entry retire;
+    struct skiplist_node node; //must be last, the tower follows it
+};
+
+static int item_cmp(void *k1, void *k2){
+    struct item *i = skiplist_entry(k1, struct item, node), *j = skiplist_entry(k2, struct item, node);
+    return (i->key > j->key) - (i->key < j->key);
+}
+
+static void item_free(struct skiplist_epoch_entry *entry){
+    free(skiplist_entry(entry, struct item, retire));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// benchmark
+///////////////////////////////////////////////////////////////////////////////
+#define SWMR_MAX_READERS 64
+#define SWMR_SCAN_LEN 64
+
+struct bench{
+    int key_range;
+    int stop;
+    struct skiplist sl;
+    struct skiplist_epoch epoch;
+    struct skiplist_epoch_thread records[SWMR_MAX_READERS + 1];
+};
+
+struct reader{
+    struct bench *b;
+    int id;
+    uint64_t seed;
+    long ops;
+    pthread_t tid;
+};
+
+static inline uint64_t xorshift64(uint64_t *s){
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+static void *reader_run(void *arg){
+    struct reader *r = arg;
+    struct bench *b = r->b;
+    struct skiplist_epoch_thread *thr = &b->records[r->id];
+    while(!__atomic_load_n(&b->stop, __ATOMIC_RELAXED)){
+        int i = 0;
+        skiplist_epoch_enter(&b->epoch, thr);
+        for(; i < 255; i++){ //point lookups
+            struct item probe = { .key = (int)(xorshift64(&r->seed) % b->key_range) };
+            struct skiplist_node *node = skiplist_get(&b->sl, &probe.node);
+            if(NULL != node) assert(probe.key == skiplist_entry(node, struct item, node)->value);
+        }
+        struct item lo = { .key = (int)(xorshift64(&r->seed) % b->key_range) }; //one short scan
+        struct skiplist_range range = skiplist_range_begin(&b->sl, &lo.node, NULL);
+        struct skiplist_node *pos = NULL;
+        int n = 0, last = lo.key - 1;
+        while(n++ < SWMR_SCAN_LEN && NULL != (pos = skiplist_range_next(&range))){
+            struct item *it = skiplist_entry(pos, struct item, node);
+            assert(last < it->key && it->key == it->value);
+            last = it->key;
+        }
+        struct item hi = { .key = lo.key + SWMR_SCAN_LEN }; //and a bounded one, the writer moves around 'hi'
+        range = skiplist_range_begin(&b->sl, &lo.node, &hi.node);
+        last = lo.key - 1;
+        while(NULL != (pos = skiplist_range_next(&range))){
+            struct item *it = skiplist_entry(pos, struct item, node);
+            assert(last < it->key && it->key <= hi.key && it->key == it->value);
+            last = it->key;
+        }
+        skiplist_epoch_exit(thr);
+        r->ops += 256;
+    }
+    return NULL;
+}
+
+static long writer_run(struct bench *b, int millis){
+    struct skiplist_epoch_thread *thr = &b->records[SWMR_MAX_READERS];
+    uint64_t seed = 88172645463325252ULL;
+    int64_t end = getCurrentTime() + millis;
+    long ops = 0;
+    while(getCurrentTime() < end){
+        int i = 0;
+        skiplist_epoch_enter(&b->epoch, thr);
+        for(; i < 64; i++){
+            uint64_t r = xorshift64(&seed);
+            struct item probe = { .key = (int)(r % b->key_range) };
+            if(r >> 63){
+                struct item *it = SKIPLIST_NODE_ALLOC(&b->sl, struct item, node);
+                assert(NULL != it);
+                it->key = it->value = probe.key;
+                if(SKIPLIST_OK != skiplist_put(&b->sl, &it->node)) free(it); //never published
+            }else{
+                struct skiplist_node *node = skiplist_remove(&b->sl, &probe.node);
+                if(NULL != node){
+                    struct item *it = skiplist_entry(node, struct item, node);
+                    it->retire.free_entry = item_free;
+                    skiplist_epoch_retire(&b->epoch, thr, &it->retire); //readers may still stand on it
+                }
+            }
+        }
+        skiplist_epoch_exit(thr);
+        ops += 64;
+    }
+    return ops;
+}
+
+//a cursor opened before the writer links a key past 'hi' and unlinks the node after it still ends at 'hi'
+void cover_testing() __attribute__((unused));
+void cover_testing() {
+    struct skiplist sl;
+    struct item *items[11] = { NULL }, lo = { .key = 20 }, hi = { .key = 40 }, probe = { .key = 50 };
+    skiplist_init(&sl, item_cmp);
+    int i = 0;
+    for(; i < 10; i++){
+        assert(NULL != (items[i] = SKIPLIST_NODE_ALLOC(&sl, struct item, node)));
+        items[i]->key = items[i]->value = i * 10;
+        assert(SKIPLIST_OK == skiplist_put(&sl, &items[i]->node));
+    }
+    struct skiplist_range range = skiplist_range_begin(&sl, &lo.node, &hi.node);
+    assert(NULL != (items[10] = SKIPLIST_NODE_ALLOC(&sl, struct item, node)));
+    items[10]->key = items[10]->value = 45;
+    assert(SKIPLIST_OK == skiplist_put(&sl, &items[10]->node));
+    assert(&items[5]->node == skiplist_remove(&sl, &probe.node));
+    struct skiplist_node *pos = NULL;
+    for(i = 20; NULL != (pos = skiplist_range_next(&range)); i += 10){
+        assert(i == skiplist_entry(pos, struct item, node)->key);
+    }
+    assert(50 == i && NULL == skiplist_range_next(&range));
+    for(i = 0; i < 11; i++){
+        free(items[i]);
+    }
+}
+
+static void bench_run(int readers, int key_range, int millis){
+    static struct bench b;
+    struct reader rs[SWMR_MAX_READERS];
+    memset(&b, 0, sizeof(b));
+    b.key_range = key_range;
+    skiplist_init(&b.sl, item_cmp);
+    skiplist_epoch_init(&b.epoch);
+    int i = 0;
+    for(; i <= SWMR_MAX_READERS; i++){
+        skiplist_epoch_register(&b.epoch, &b.records[i]);
+    }
+    for(i = 0; i < key_range; i += 2){
+        struct item *it = SKIPLIST_NODE_ALLOC(&b.sl, struct item, node);
+        assert(NULL != it);
+        it->key = it->value = i;
+        assert(SKIPLIST_OK == skiplist_put(&b.sl, &it->node));
+    }
+
+    for(i = 0; i < readers; i++){
+        rs[i] = (struct reader){ .b = &b, .id = i, .seed = 0x9E3779B97F4A7C15ULL * (i + 1), .ops = 0 };
+        assert(0 == pthread_create(&rs[i].tid, NULL, reader_run, &rs[i]));
+    }
+    long writes = writer_run(&b, millis);
+    __atomic_store_n(&b.stop, 1, __ATOMIC_RELAXED);
+    long reads = 0;
+    for(i = 0; i < readers; i++){
+        pthread_join(rs[i].tid, NULL);
+        reads += rs[i].ops;
+    }
+    printf("%8d %16.2f %16.2f\n", readers, (double)reads / millis / 1000.0, (double)writes / millis / 1000.0);
+
+    skiplist_epoch_destroy(&b.epoch);
+    struct skiplist_node *pos, *iter = NULL;
+    SKIPLIST_FOREACH_NEXT(&b.sl, pos, iter){
+        free(skiplist_entry(pos, struct item, node));
+    }
+}
+
+int main(int argc, char **argv){
+    int max_readers = argc > 1 ? atoi(argv[1]) : SWMR_MAX_READERS;
+    int key_range = argc > 2 ? atoi(argv[2]) : 1000000;
+    int millis = argc > 3 ? atoi(argv[3]) : 500;
+    if(max_readers < 1 || max_readers > SWMR_MAX_READERS) max_readers = SWMR_MAX_READERS;
+
+    cover_testing();
+    printf("keys:%d cpus:%ld\n", key_range, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %16s %16s\n", "readers", "reads Mops/s", "writes Mops/s");
+    int readers = 1;
+    for(; readers <= max_readers; readers *= 2){
+        bench_run(readers, key_range, millis);
+    }
+
+    printf("over\n");
+    return 0;
+}
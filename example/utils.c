@@ -38,6 +38,12 @@ int64_t getCurrentTime() {
    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+int64_t getCurrentTimeNs() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 char *random_str(int len) {
     int i;
     char *alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -74,11 +80,24 @@ char *random_str_num(int len) {
     return string;
 }
 
+//pread until 'len' bytes arrived: no shared file offset, so concurrent readers of one fd are fine
+int read_from_file(int fd, void *buf, uint32_t len, off_t pos) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, pos);
+        if (n < 0 && EINTR == errno) continue;
+        if (n <= 0) return -1;
+        p += n;
+        pos += n;
+        len -= n;
+    }
+    return 0;
+}
+
 char *read_value_from_file(int fd, uint32_t value_len, off_t value_pos) {
-    char *value = calloc(1, value_len);
+    char *value = malloc(value_len > 0 ? value_len : 1);
     if (NULL == value) goto err;
-    if (-1 == lseek(fd, value_pos, SEEK_SET)) goto err;
-    if (value_len != read(fd, value, value_len)) goto err;
+    if (0 != read_from_file(fd, value, value_len, value_pos)) goto err;
     return value;
 
 err:
@@ -34,11 +34,13 @@ extern "C" {
 int random_range(int min, int max);
 
 int64_t getCurrentTime();
+int64_t getCurrentTimeNs(); //monotonic
 
 char *random_str(int len);
 char *random_str_shortly(int len);
 char *random_str_num(int len);
 
+int read_from_file(int fd, void *buf, uint32_t len, off_t pos);
 char *read_value_from_file(int fd, uint32_t value_len, off_t value_pos);
 
 #ifdef __cplusplus
@@ -23,80 +23,334 @@ extern "C" {
 #endif
 
     #include <stdlib.h>
+    #include <stddef.h>
+    #include <stdint.h>
 
     #define SKIPLIST_OK 0
     #define SKIPLIST_ERR -1
-    #define SKIPLIST_MAXLEVEL 8
+    #ifndef SKIPLIST_MAXLEVEL
+    #define SKIPLIST_MAXLEVEL 32 //hard upper bound, enough for 4^32 items at p=0.25
+    #endif
 
+    struct skiplist_node;
+    struct skiplist_link{
+        struct skiplist_node *next;
+        int span; //level-0 steps to 'next', the header counts as position busy+1
+    };
+
+    //the tower is sized to the node's own level, so the node must be the last member of the embedding struct
     struct skiplist_node{
         int level;
-        struct skiplist_node *prev[SKIPLIST_MAXLEVEL];
-        struct skiplist_node *next[SKIPLIST_MAXLEVEL];
+        struct skiplist_node *prev;   //backward link, level 0 only
+        struct skiplist_link link[];
+    };
+
+    //-DSKIPLIST_STATS: every list counts its searches, compares and hops per level, its puts, gets and dels,
+    //and keeps a live histogram of tower heights; skiplist_stats takes a snapshot. Without it nothing is
+    //counted and the hooks compile to nothing
+    struct skiplist_stats{
+        unsigned long searches; //descents, from the header or from a finger
+        unsigned long cmps;     //compares made by the descents
+        unsigned long hops[SKIPLIST_MAXLEVEL]; //forward steps taken on every level
+        unsigned long puts;     //nodes linked, replacements included
+        unsigned long gets;     //point lookups
+        unsigned long dels;     //nodes unlinked
+        unsigned long levels[SKIPLIST_MAXLEVEL + 1]; //live nodes by tower height
+        int busy;               //the rest is only filled in by skiplist_stats
+        int level;
+        int maxlevel;
     };
 
     typedef int skiplist_cmp_item(void *k1, void *k2);
     struct skiplist{
         int busy;
+        int level;    //current height, levels above it only hold the header
+        int maxlevel; //per-list cap, 1..SKIPLIST_MAXLEVEL
+        unsigned int version; //bumped by every link and unlink, invalidates fingers
+        uint64_t rng;         //level generator, see skiplist_seed
         skiplist_cmp_item *cmp_item;
-        struct skiplist_node header[1];
+        union{
+            struct skiplist_node header[1];
+            char header_storage[sizeof(struct skiplist_node) + SKIPLIST_MAXLEVEL * sizeof(struct skiplist_link)];
+        };
+    #ifdef SKIPLIST_STATS
+        struct skiplist_stats stats;
+    #endif
+    };
+
+    //a cached search path, owned by one caller; searches through it cost O(log d) in the distance d from the last one
+    struct skiplist_finger{
+        int valid;
+        unsigned int version;
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL];
+        int ranks[SKIPLIST_MAXLEVEL];
     };
 
-    #define SKIPLIST_P 0.25
-    #define SKIPLIST_RANDOM_LEVEL() \
-        ({ \
-            int level = 1; \
-            while ((random() & 0xFFFF) < (SKIPLIST_P * 0xFFFF)) \
-                level += 1; \
-            level < SKIPLIST_MAXLEVEL ? level : SKIPLIST_MAXLEVEL; \
-        })
+    #define skiplist_entry(ptr, type, member) \
+        ((type *)((char *)(ptr) - offsetof(type, member)))
+
+    //p = 2^-SKIPLIST_P_SHIFT, so a level costs one draw: every SKIPLIST_P_SHIFT trailing zero bits add one
+    #ifndef SKIPLIST_P_SHIFT
+    #define SKIPLIST_P_SHIFT 2
+    #endif
+    #define SKIPLIST_P (1.0 / (1 << SKIPLIST_P_SHIFT))
+    #define SKIPLIST_SEED 0x9E3779B97F4A7C15ULL
+
+    //wyrand, any state is fine and it only ever moves forward by a constant
+    static inline uint64_t skiplist_rand(uint64_t *state){
+        *state += 0xA0761D6478BD642FULL;
+        __uint128_t m = (__uint128_t)*state * (*state ^ 0xE7037ED1A0B428DBULL);
+        return (uint64_t)(m >> 64) ^ (uint64_t)m;
+    }
+
+    static inline int skiplist_level_draw(uint64_t *state, int maxlevel){
+        int level = 1 + __builtin_ctzll(skiplist_rand(state) | (1ULL << 63)) / SKIPLIST_P_SHIFT;
+        return level < maxlevel ? level : maxlevel;
+    }
+
+    //per-thread generator for callers without a list at hand (or sharing one across threads), seeded from
+    //the thread's own address unless skiplist_thread_seed was called
+    static __thread uint64_t skiplist_thread_state;
+    static inline void skiplist_thread_seed(uint64_t seed){
+        skiplist_thread_state = seed ^ SKIPLIST_SEED;
+    }
+
+    static inline int skiplist_thread_level(int maxlevel){
+        if(0 == skiplist_thread_state){
+            skiplist_thread_state = (uint64_t)(uintptr_t)&skiplist_thread_state ^ SKIPLIST_SEED;
+        }
+        return skiplist_level_draw(&skiplist_thread_state, maxlevel);
+    }
+
+    #define SKIPLIST_RANDOM_LEVEL(maxlevel) skiplist_thread_level(maxlevel)
+
+    //single-writer / multi-reader mode: the writer publishes links with release stores and readers
+    //follow them with acquire loads, so lookups, seeks and scans need no lock. Rank, select and
+    //range counts read the spans and stay writer-side. Freed nodes must wait for a grace period,
+    //see skiplist_epoch.h
+    #ifdef SKIPLIST_SWMR
+    #define SKIPLIST_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+    #define SKIPLIST_STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+    #else
+    #define SKIPLIST_LOAD(p) (p)
+    #define SKIPLIST_STORE(p, v) ((p) = (v))
+    #endif
+
+    //-DSKIPLIST_PREFETCH: while a node is compared, the search already fetches the one after it
+    #ifdef SKIPLIST_PREFETCH
+    #define SKIPLIST_PREFETCH_NEXT(node, i) __builtin_prefetch(SKIPLIST_LOAD((node)->link[i].next))
+    #else
+    #define SKIPLIST_PREFETCH_NEXT(node, i) ((void)0)
+    #endif
+
+    #ifdef SKIPLIST_STATS
+    #ifdef SKIPLIST_SWMR
+    #define SKIPLIST_STAT_ADD(sl, field, n) ((void)__atomic_fetch_add(&(sl)->stats.field, (n), __ATOMIC_RELAXED))
+    #else
+    #define SKIPLIST_STAT_ADD(sl, field, n) ((void)((sl)->stats.field += (n)))
+    #endif
+    #else
+    #define SKIPLIST_STAT_ADD(sl, field, n) ((void)0)
+    #endif
+
+    //bound 0 stops before the first node >= 'node', bound 1 stops before the first node > 'node'
+    //'cmp' is called like cmp_item, a static function here lets the compiler inline it (see SKIPLIST_DEFINE)
+    #define SKIPLIST_TRACK_CMP_BOUND(sl, node, bound, tracks, cmp) \
+        do{ \
+            struct skiplist_node *tmp_node = (sl)->header, *next_node = NULL; \
+            int i = SKIPLIST_LOAD((sl)->level) - 1; \
+            SKIPLIST_STAT_ADD(sl, searches, 1); \
+            for(; i >= 0; i--){ \
+                while((next_node = SKIPLIST_LOAD(tmp_node->link[i].next)) != (sl)->header && \
+                        (SKIPLIST_PREFETCH_NEXT(next_node, i), SKIPLIST_STAT_ADD(sl, cmps, 1), (bound) > cmp(next_node, (node)))){ \
+                    SKIPLIST_STAT_ADD(sl, hops[i], 1); \
+                    tmp_node = next_node; \
+                } \
+                (tracks)[i] = tmp_node; \
+            } \
+        }while(0)
+
+    #define SKIPLIST_TRACK_BOUND(sl, node, bound, tracks) SKIPLIST_TRACK_CMP_BOUND(sl, node, bound, tracks, (sl)->cmp_item)
+    #define SKIPLIST_TRACK(sl, node, tracks) SKIPLIST_TRACK_BOUND(sl, node, 0, tracks)
 
-    #define SKIPLIST_TRACK(sl, node, tracks) \
+    //same as SKIPLIST_TRACK_CMP_BOUND, also records the rank of every track (the header is rank 0)
+    #define SKIPLIST_TRACK_RANK_CMP_BOUND(sl, node, bound, tracks, ranks, cmp) \
         do{ \
-            struct skiplist_node *tmp_node = (sl)->header; \
-            int i = SKIPLIST_MAXLEVEL - 1; \
+            struct skiplist_node *tmp_node = (sl)->header, *next_node = NULL; \
+            int rank = 0; \
+            int i = (sl)->level - 1; \
+            SKIPLIST_STAT_ADD(sl, searches, 1); \
             for(; i >= 0; i--){ \
-                while(tmp_node->next[i] != (sl)->header && \
-                        0 > (sl)->cmp_item(tmp_node->next[i], (node))){ \
-                    tmp_node = tmp_node->next[i]; \
+                while((next_node = tmp_node->link[i].next) != (sl)->header && \
+                        (SKIPLIST_PREFETCH_NEXT(next_node, i), SKIPLIST_STAT_ADD(sl, cmps, 1), (bound) > cmp(next_node, (node)))){ \
+                    SKIPLIST_STAT_ADD(sl, hops[i], 1); \
+                    rank += tmp_node->link[i].span; \
+                    tmp_node = next_node; \
                 } \
                 (tracks)[i] = tmp_node; \
+                (ranks)[i] = rank; \
             } \
         }while(0)
 
+    #define SKIPLIST_TRACK_RANK_BOUND(sl, node, bound, tracks, ranks) \
+        SKIPLIST_TRACK_RANK_CMP_BOUND(sl, node, bound, tracks, ranks, (sl)->cmp_item)
+    #define SKIPLIST_TRACK_RANK(sl, node, tracks, ranks) SKIPLIST_TRACK_RANK_BOUND(sl, node, 0, tracks, ranks)
+
     #define SKIPLIST_FOREACH_PREV(sl, pos, iter) \
-        for ((pos) = (sl)->header->prev[0], (iter) = (pos)->prev[0]; \
+        for ((pos) = SKIPLIST_LOAD((sl)->header->prev), (iter) = SKIPLIST_LOAD((pos)->prev); \
             (pos) != (sl)->header; \
-            (pos) = (iter), (iter) = (pos)->prev[0])
+            (pos) = (iter), (iter) = SKIPLIST_LOAD((pos)->prev))
 
     #define SKIPLIST_FOREACH_NEXT(sl, pos, iter) \
-        for ((pos) = (sl)->header->next[0], (iter) = (pos)->next[0]; \
+        for ((pos) = SKIPLIST_LOAD((sl)->header->link[0].next), (iter) = SKIPLIST_LOAD((pos)->link[0].next); \
             (pos) != (sl)->header; \
-            (pos) = (iter), (iter) = (pos)->next[0])
+            (pos) = (iter), (iter) = SKIPLIST_LOAD((pos)->link[0].next))
 
-    static inline void skiplist_init(struct skiplist *sl, skiplist_cmp_item *cmp_item){
+    //visits the nodes ranked 'from'..'to' (1-based, inclusive), 'n' is an int counter; do not unlink 'pos' inside
+    #define SKIPLIST_FOREACH_RANK(sl, pos, n, from, to) \
+        for ((pos) = skiplist_select((sl), (from)), (n) = (from); \
+            NULL != (pos) && (pos) != (sl)->header && (n) <= (to); \
+            (pos) = (pos)->link[0].next, (n)++)
+
+    static inline void skiplist_init_maxlevel(struct skiplist *sl, skiplist_cmp_item *cmp_item, int maxlevel){
         sl->busy = 0;
+        sl->level = 1;
+        sl->version = 0;
+        sl->rng = SKIPLIST_SEED;
+        sl->maxlevel = maxlevel < 1 ? 1 : (maxlevel > SKIPLIST_MAXLEVEL ? SKIPLIST_MAXLEVEL : maxlevel);
         sl->cmp_item = cmp_item;
-        *(sl->header) = (struct skiplist_node){
-                            .level = SKIPLIST_MAXLEVEL,
-                            .prev = {[0 ... SKIPLIST_MAXLEVEL-1] = sl->header},
-                            .next = {[0 ... SKIPLIST_MAXLEVEL-1] = sl->header}
-                        };
+    #ifdef SKIPLIST_STATS
+        sl->stats = (struct skiplist_stats){ 0 };
+    #endif
+        sl->header->level = SKIPLIST_MAXLEVEL;
+        sl->header->prev = sl->header;
+        int i = 0;
+        for(; i < SKIPLIST_MAXLEVEL; i++){
+            sl->header->link[i].next = sl->header;
+            sl->header->link[i].span = 1;
+        }
+    }
+
+    static inline void skiplist_init(struct skiplist *sl, skiplist_cmp_item *cmp_item){
+        skiplist_init_maxlevel(sl, cmp_item, SKIPLIST_MAXLEVEL);
+    }
+
+    //empties the list without visiting the nodes, for owners that free them all at once (see skiplist_arena.h)
+    static inline void skiplist_destroy(struct skiplist *sl){
+        unsigned int version = sl->version;
+        uint64_t rng = sl->rng;
+    #ifdef SKIPLIST_STATS
+        struct skiplist_stats stats = sl->stats; //the counters outlive the nodes, the histogram does not
+        skiplist_init_maxlevel(sl, sl->cmp_item, sl->maxlevel);
+        sl->stats = stats;
+        int i = 0;
+        for(; i <= SKIPLIST_MAXLEVEL; i++){
+            sl->stats.levels[i] = 0;
+        }
+    #else
+        skiplist_init_maxlevel(sl, sl->cmp_item, sl->maxlevel);
+    #endif
+        sl->version = version + 1; //fingers into the old nodes go stale
+        sl->rng = rng;
+    }
+
+    //bytes taken by an item of 'size' bytes whose node (at 'offset') has a tower of 'level'
+    static inline size_t skiplist_node_size(size_t size, size_t offset, int level){
+        size_t need = offset + offsetof(struct skiplist_node, link) + level * sizeof(struct skiplist_link);
+        return need > size ? need : size;
+    }
+
+    //allocates a zeroed item of 'size' bytes whose node (at 'offset') has a tower of 'level'
+    static inline void *skiplist_node_alloc_level(size_t size, size_t offset, int level){
+        char *item = (char *)calloc(1, skiplist_node_size(size, offset, level));
+        if(NULL == item) return NULL;
+        ((struct skiplist_node *)(item + offset))->level = level;
+        return item;
+    }
+
+    //reseeds the list's level generator, equal seeds give equal tower heights run after run
+    static inline void skiplist_seed(struct skiplist *sl, uint64_t seed){
+        sl->rng = seed ^ SKIPLIST_SEED;
+    }
+
+    //a tower height drawn from the list's own generator, so it belongs to the list's writer (or lock).
+    //-DSKIPLIST_ADAPTIVE_LEVEL caps it one level above what the current size needs, small lists keep
+    //short towers and the header stays low
+    static inline int skiplist_random_level(struct skiplist *sl){
+    #ifdef SKIPLIST_ADAPTIVE_LEVEL
+        int cap = 2;
+        unsigned int n = (unsigned int)sl->busy + 1;
+        while(0 != (n >>= SKIPLIST_P_SHIFT)) cap += 1;
+        return skiplist_level_draw(&sl->rng, cap < sl->maxlevel ? cap : sl->maxlevel);
+    #else
+        return skiplist_level_draw(&sl->rng, sl->maxlevel);
+    #endif
+    }
+
+    //same, with a random tower sized for 'sl'
+    static inline void *skiplist_node_alloc(struct skiplist *sl, size_t size, size_t offset){
+        return skiplist_node_alloc_level(size, offset, skiplist_random_level(sl));
+    }
+
+    #define SKIPLIST_NODE_ALLOC(sl, type, member) \
+        ((type *)skiplist_node_alloc((sl), sizeof(type), offsetof(type, member)))
+
+    #define SKIPLIST_NODE_ALLOC_LEVEL(type, member, level) \
+        ((type *)skiplist_node_alloc_level(sizeof(type), offsetof(type, member), (level)))
+
+    //tower height of the node at 1-based position 'rank' in a perfectly balanced list, for bulk loads
+    static inline int skiplist_bulk_level(struct skiplist *sl, int rank){
+        int step = (int)(1 / SKIPLIST_P + 0.5), level = 1;
+        while(level < sl->maxlevel && rank > 0 && 0 == rank % step){
+            rank /= step;
+            level += 1;
+        }
+        return level;
+    }
+
+    //a node a list can take: it has a tower and the tower is no taller than the list's cap. Towers are
+    //never cut down to fit, the level also tells where inline data after the tower starts and how big
+    //the block is (skiplist_node_tail, the arena), so a node from a taller list is refused instead
+    #define SKIPLIST_NODE_FITS(sl, node) ((node)->level >= 1 && (node)->level <= (sl)->maxlevel)
+
+    //'tracks' and 'ranks' must hold the predecessors of 'new_node' on every level of the list, which it must fit
+    static inline void skiplist_link(struct skiplist *sl, struct skiplist_node **tracks, int *ranks, struct skiplist_node *new_node){
+        int i = sl->level;
+        for(; i < new_node->level; i++){ //grow the list, new levels start from the header
+            tracks[i] = sl->header;
+            ranks[i] = 0;
+            sl->header->link[i].span = sl->busy + 1;
+        }
+        if(new_node->level > sl->level){
+            SKIPLIST_STORE(sl->level, new_node->level);
+        }
+        new_node->prev = tracks[0];
+        i = 0;
+        for(; i < new_node->level; i ++){ //bottom-up, the node is fully formed before it becomes reachable
+            struct skiplist_node *p = tracks[i];
+            new_node->link[i].next = p->link[i].next;
+            new_node->link[i].span = p->link[i].span - (ranks[0] - ranks[i]);
+            SKIPLIST_STORE(p->link[i].next, new_node);
+            p->link[i].span = ranks[0] - ranks[i] + 1;
+        }
+        for(; i < sl->level; i++){ //levels stepping over the new node
+            tracks[i]->link[i].span += 1;
+        }
+        SKIPLIST_STORE(new_node->link[0].next->prev, new_node);
+        SKIPLIST_STAT_ADD(sl, puts, 1);
+        SKIPLIST_STAT_ADD(sl, levels[new_node->level], 1);
+        sl->busy += 1;
+        sl->version += 1;
     }
 
     static inline int skiplist_put(struct skiplist *sl, struct skiplist_node *new_node){
+        if(!SKIPLIST_NODE_FITS(sl, new_node)) return SKIPLIST_ERR; //not allocated by skiplist_node_alloc for a list like 'sl'
         struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
-        SKIPLIST_TRACK(sl, new_node, tracks);
-        struct skiplist_node *existing_node = tracks[0]->next[0];
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_TRACK_RANK(sl, new_node, tracks, ranks);
+        struct skiplist_node *existing_node = tracks[0]->link[0].next;
         if(sl->header == existing_node || 0 != sl->cmp_item(existing_node, new_node)){
-            new_node->level = SKIPLIST_RANDOM_LEVEL();
-            int i = 0;
-            for(; i < new_node->level; i ++){
-                struct skiplist_node *p = tracks[i], *n = p->next[i];
-                p->next[i] = n->prev[i] = new_node;
-                new_node->prev[i] = p;
-                new_node->next[i] = n;
-            }
-            sl->busy += 1;
+            skiplist_link(sl, tracks, ranks, new_node);
             return SKIPLIST_OK;
         }
         return SKIPLIST_ERR;
@@ -105,28 +359,762 @@ extern "C" {
     static inline struct skiplist_node *skiplist_get(struct skiplist *sl, struct skiplist_node *node){
         struct skiplist_node *res = NULL;
         struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_STAT_ADD(sl, gets, 1);
         SKIPLIST_TRACK(sl, node, tracks);
-        struct skiplist_node *existing_node = tracks[0]->next[0];
+        struct skiplist_node *existing_node = SKIPLIST_LOAD(tracks[0]->link[0].next);
         if(sl->header != existing_node && 0 == sl->cmp_item(existing_node, node)){
             res = existing_node;
         }
         return res;
     }
 
+    #ifndef SKIPLIST_BATCH
+    #define SKIPLIST_BATCH 16 //searches kept in flight by skiplist_get_batch
+    #endif
+
+    //looks up 'n' nodes at once, out[k] receives the node equal to nodes[k] or NULL. Up to SKIPLIST_BATCH
+    //searches advance in turns one compare at a time, each prefetching the node of its next compare, so
+    //their cache misses overlap instead of queuing up
+    static inline void skiplist_get_batch(struct skiplist *sl, struct skiplist_node **nodes, int n, struct skiplist_node **out){
+        struct skiplist_node *tracks[SKIPLIST_BATCH];
+        int levels[SKIPLIST_BATCH];
+        int base = 0;
+        SKIPLIST_STAT_ADD(sl, gets, n);
+        SKIPLIST_STAT_ADD(sl, searches, n);
+        for(; base < n; base += SKIPLIST_BATCH){
+            int count = n - base < SKIPLIST_BATCH ? n - base : SKIPLIST_BATCH, active = count, k = 0;
+            int top = SKIPLIST_LOAD(sl->level) - 1;
+            __builtin_prefetch(SKIPLIST_LOAD(sl->header->link[top].next));
+            for(; k < count; k++){
+                tracks[k] = sl->header;
+                levels[k] = top;
+            }
+            while(active > 0){
+                for(k = 0; k < count; k++){
+                    int i = levels[k];
+                    if(i < 0) continue; //done
+                    struct skiplist_node *next_node = SKIPLIST_LOAD(tracks[k]->link[i].next);
+                    if(sl->header != next_node && (SKIPLIST_STAT_ADD(sl, cmps, 1), 0 > sl->cmp_item(next_node, nodes[base + k]))){
+                        SKIPLIST_STAT_ADD(sl, hops[i], 1);
+                        tracks[k] = next_node;
+                        __builtin_prefetch(SKIPLIST_LOAD(next_node->link[i].next));
+                    }else if(i > 0){
+                        levels[k] = i - 1;
+                        __builtin_prefetch(SKIPLIST_LOAD(tracks[k]->link[i - 1].next));
+                    }else{
+                        levels[k] = -1;
+                        active -= 1;
+                        out[base + k] = (sl->header != next_node && 0 == sl->cmp_item(next_node, nodes[base + k])) ? next_node : NULL;
+                    }
+                }
+            }
+        }
+    }
+
+    //'tracks' must hold the predecessors of 'del_node' on every level of the list
+    //the links of 'del_node' itself are left intact so readers standing on it can move on
+    static inline void skiplist_unlink(struct skiplist *sl, struct skiplist_node **tracks, struct skiplist_node *del_node){
+        int i = 0;
+        for(; i < del_node->level; i++){
+            SKIPLIST_STORE(tracks[i]->link[i].next, del_node->link[i].next);
+            tracks[i]->link[i].span += del_node->link[i].span - 1;
+        }
+        for(; i < sl->level; i++){
+            tracks[i]->link[i].span -= 1;
+        }
+        SKIPLIST_STORE(del_node->link[0].next->prev, del_node->prev);
+        while(sl->level > 1 && sl->header->link[sl->level - 1].next == sl->header){ //shrink the list
+            SKIPLIST_STORE(sl->level, sl->level - 1);
+        }
+        SKIPLIST_STAT_ADD(sl, dels, 1);
+        SKIPLIST_STAT_ADD(sl, levels[del_node->level], -1);
+        sl->busy -= 1;
+        sl->version += 1;
+    }
+
     static inline int skiplist_del(struct skiplist *sl, struct skiplist_node *del_node){
         if(sl->header != del_node){
-            int i = 0;
-            for(; i < del_node->level; i++){
-                struct skiplist_node *p = del_node->prev[i], *n = del_node->next[i];
-                p->next[i] = n;
-                n->prev[i] = p;
+            struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+            SKIPLIST_TRACK(sl, del_node, tracks);
+            if(tracks[0]->link[0].next == del_node){
+                skiplist_unlink(sl, tracks, del_node);
+                return SKIPLIST_OK;
+            }
+        }
+        return SKIPLIST_ERR;
+    }
+
+    //unlinks and returns the node equal to 'node' in a single search, or NULL
+    static inline struct skiplist_node *skiplist_remove(struct skiplist *sl, struct skiplist_node *node){
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_TRACK(sl, node, tracks);
+        struct skiplist_node *existing_node = tracks[0]->link[0].next;
+        if(sl->header != existing_node && 0 == sl->cmp_item(existing_node, node)){
+            skiplist_unlink(sl, tracks, existing_node);
+            return existing_node;
+        }
+        return NULL;
+    }
+
+    //puts 'new_node' at the position of 'old_node', 'tracks' and 'ranks' must hold the predecessors of
+    //'old_node' on every level. The shared part of the towers is copied over, the rest is linked or
+    //unlinked as in skiplist_link/skiplist_unlink; ranks and busy do not change
+    static inline void skiplist_swap(struct skiplist *sl, struct skiplist_node **tracks, int *ranks,
+                                        struct skiplist_node *old_node, struct skiplist_node *new_node){
+        int i = sl->level;
+        for(; i < new_node->level; i++){ //grow the list, new levels start from the header
+            tracks[i] = sl->header;
+            ranks[i] = 0;
+            sl->header->link[i].span = sl->busy + 1;
+        }
+        if(new_node->level > sl->level){
+            SKIPLIST_STORE(sl->level, new_node->level);
+        }
+        new_node->prev = old_node->prev;
+        for(i = 0; i < new_node->level; i++){ //fully form the new node before it becomes reachable
+            if(i < old_node->level){
+                new_node->link[i] = old_node->link[i];
+            }else{
+                new_node->link[i].next = tracks[i]->link[i].next;
+                new_node->link[i].span = tracks[i]->link[i].span - (ranks[0] - ranks[i]) - 1; //the old node is still counted
+            }
+        }
+        for(i = 0; i < new_node->level; i++){ //bottom-up, same as skiplist_link
+            SKIPLIST_STORE(tracks[i]->link[i].next, new_node);
+            if(i >= old_node->level){
+                tracks[i]->link[i].span = ranks[0] - ranks[i] + 1;
+            }
+        }
+        for(; i < old_node->level; i++){ //levels only the old tower reached
+            SKIPLIST_STORE(tracks[i]->link[i].next, old_node->link[i].next);
+            tracks[i]->link[i].span += old_node->link[i].span;
+        }
+        SKIPLIST_STORE(new_node->link[0].next->prev, new_node);
+        while(sl->level > 1 && sl->header->link[sl->level - 1].next == sl->header){ //shrink the list
+            SKIPLIST_STORE(sl->level, sl->level - 1);
+        }
+        SKIPLIST_STAT_ADD(sl, puts, 1);
+        SKIPLIST_STAT_ADD(sl, levels[old_node->level], -1);
+        SKIPLIST_STAT_ADD(sl, levels[new_node->level], 1);
+        sl->version += 1;
+    }
+
+    //inserts 'new_node' or puts it in place of the node with the same key, in a single search
+    //'*old_node' receives the displaced node (still intact, the caller frees it) or NULL
+    static inline int skiplist_upsert(struct skiplist *sl, struct skiplist_node *new_node, struct skiplist_node **old_node){
+        *old_node = NULL;
+        if(!SKIPLIST_NODE_FITS(sl, new_node)) return SKIPLIST_ERR;
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_TRACK_RANK(sl, new_node, tracks, ranks);
+        struct skiplist_node *existing_node = tracks[0]->link[0].next;
+        if(sl->header == existing_node || 0 != sl->cmp_item(existing_node, new_node)){
+            skiplist_link(sl, tracks, ranks, new_node);
+        }else{
+            skiplist_swap(sl, tracks, ranks, existing_node, new_node);
+            *old_node = existing_node;
+        }
+        return SKIPLIST_OK;
+    }
+
+    //puts 'new_node' in place of the node with the same key and returns that node, NULL (and
+    //'new_node' is not linked) if there is none
+    static inline struct skiplist_node *skiplist_replace(struct skiplist *sl, struct skiplist_node *new_node){
+        if(!SKIPLIST_NODE_FITS(sl, new_node)) return NULL;
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_TRACK_RANK(sl, new_node, tracks, ranks);
+        struct skiplist_node *existing_node = tracks[0]->link[0].next;
+        if(sl->header != existing_node && 0 == sl->cmp_item(existing_node, new_node)){
+            skiplist_swap(sl, tracks, ranks, existing_node, new_node);
+            return existing_node;
+        }
+        return NULL;
+    }
+
+    //1-based position of the node equal to 'node', 0 if there is none
+    static inline int skiplist_rank(struct skiplist *sl, struct skiplist_node *node){
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_TRACK_RANK(sl, node, tracks, ranks);
+        struct skiplist_node *existing_node = tracks[0]->link[0].next;
+        if(sl->header != existing_node && 0 == sl->cmp_item(existing_node, node)){
+            return ranks[0] + 1;
+        }
+        return 0;
+    }
+
+    //the node at 1-based position 'rank', NULL if out of range
+    static inline struct skiplist_node *skiplist_select(struct skiplist *sl, int rank){
+        if(rank < 1 || rank > sl->busy) return NULL;
+        struct skiplist_node *tmp_node = sl->header;
+        int traversed = 0;
+        int i = sl->level - 1;
+        for(; i >= 0; i--){
+            while(tmp_node->link[i].next != sl->header && traversed + tmp_node->link[i].span <= rank){
+                traversed += tmp_node->link[i].span;
+                tmp_node = tmp_node->link[i].next;
             }
-            sl->busy -= 1;
+            if(traversed == rank){
+                return tmp_node;
+            }
+        }
+        return NULL;
+    }
+
+    //last node below 'node' (bound 0) or not above it (bound 1), the header if none; 'rank' receives its position
+    static inline struct skiplist_node *skiplist_floor(struct skiplist *sl, struct skiplist_node *node, int bound, int *rank){
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        if(NULL != rank){
+            int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+            SKIPLIST_TRACK_RANK_BOUND(sl, node, bound, tracks, ranks);
+            *rank = ranks[0];
+        }else{
+            SKIPLIST_TRACK_BOUND(sl, node, bound, tracks);
+        }
+        return tracks[0];
+    }
+
+    //first node >= 'node', NULL if none
+    static inline struct skiplist_node *skiplist_seek_ge(struct skiplist *sl, struct skiplist_node *node){
+        struct skiplist_node *res = SKIPLIST_LOAD(skiplist_floor(sl, node, 0, NULL)->link[0].next);
+        return sl->header != res ? res : NULL;
+    }
+
+    //first node > 'node', NULL if none
+    static inline struct skiplist_node *skiplist_seek_gt(struct skiplist *sl, struct skiplist_node *node){
+        struct skiplist_node *res = SKIPLIST_LOAD(skiplist_floor(sl, node, 1, NULL)->link[0].next);
+        return sl->header != res ? res : NULL;
+    }
+
+    //last node <= 'node', NULL if none
+    static inline struct skiplist_node *skiplist_seek_le(struct skiplist *sl, struct skiplist_node *node){
+        struct skiplist_node *res = skiplist_floor(sl, node, 1, NULL);
+        return sl->header != res ? res : NULL;
+    }
+
+    //last node < 'node', NULL if none
+    static inline struct skiplist_node *skiplist_seek_lt(struct skiplist *sl, struct skiplist_node *node){
+        struct skiplist_node *res = skiplist_floor(sl, node, 0, NULL);
+        return sl->header != res ? res : NULL;
+    }
+
+    //number of nodes in ['lo', 'hi'], a NULL bound is open
+    static inline int skiplist_range_count(struct skiplist *sl, struct skiplist_node *lo, struct skiplist_node *hi){
+        int below = 0, upto = sl->busy;
+        if(NULL != lo) skiplist_floor(sl, lo, 0, &below);
+        if(NULL != hi) skiplist_floor(sl, hi, 1, &upto);
+        return upto > below ? upto - below : 0;
+    }
+
+    //forward cursor over ['lo', 'hi'], the end node is resolved once so stepping needs no compares. Under
+    //SKIPLIST_SWMR a writer may link a key above 'hi' or unlink the end node after begin, so readers
+    //compare every node with 'hi' instead and stop at the header; 'hi' must then outlive the cursor
+    struct skiplist_range{
+        struct skiplist_node *pos;
+        struct skiplist_node *end;
+    #ifdef SKIPLIST_SWMR
+        struct skiplist *sl;
+        struct skiplist_node *hi; //NULL for an open range
+    #endif
+    };
+
+    static inline struct skiplist_range skiplist_range_begin(struct skiplist *sl, struct skiplist_node *lo, struct skiplist_node *hi){
+        struct skiplist_node *pos = SKIPLIST_LOAD((NULL != lo ? skiplist_floor(sl, lo, 0, NULL) : sl->header)->link[0].next);
+    #ifdef SKIPLIST_SWMR
+        struct skiplist_node *end = sl->header;
+    #else
+        struct skiplist_node *end = NULL != hi ? SKIPLIST_LOAD(skiplist_floor(sl, hi, 1, NULL)->link[0].next) : sl->header;
+    #endif
+        if(NULL != lo && NULL != hi && 0 < sl->cmp_item(lo, hi)){ //empty range
+            pos = end;
+        }
+    #ifdef SKIPLIST_SWMR
+        return (struct skiplist_range){ .pos = pos, .end = end, .sl = sl, .hi = hi };
+    #else
+        return (struct skiplist_range){ .pos = pos, .end = end };
+    #endif
+    }
+
+    static inline struct skiplist_node *skiplist_range_next(struct skiplist_range *range){
+        struct skiplist_node *curr = range->pos;
+        if(range->end == curr) return NULL;
+    #ifdef SKIPLIST_SWMR
+        if(NULL != range->hi && 0 < range->sl->cmp_item(curr, range->hi)){
+            range->pos = range->end;
+            return NULL;
+        }
+    #endif
+        range->pos = SKIPLIST_LOAD(curr->link[0].next);
+        return curr;
+    }
+
+    //last node of every level and its rank, the header (rank 0) on levels without one
+    static inline void skiplist_track_last(struct skiplist *sl, struct skiplist_node **tracks, int *ranks){
+        struct skiplist_node *tmp_node = sl->header;
+        int rank = 0, i = sl->level - 1;
+        for(; i >= 0; i--){
+            while(tmp_node->link[i].next != sl->header){
+                rank += tmp_node->link[i].span;
+                tmp_node = tmp_node->link[i].next;
+            }
+            tracks[i] = tmp_node;
+            ranks[i] = rank;
+        }
+    }
+
+    static inline void skiplist_shrink(struct skiplist *sl){
+        while(sl->level > 1 && sl->header->link[sl->level - 1].next == sl->header){
+            sl->level -= 1;
+        }
+    }
+
+    //split, join and range delete relink whole towers at the cut in O(log n) and leave the nodes where
+    //they are; they are writer-side like rank and select, no SWMR reader may be in flight
+
+    //moves the nodes from the first one >= 'node' (bound 0) or > 'node' (bound 1) on into the empty list
+    //'out', which must take towers as tall as those of 'sl'
+    static inline int skiplist_split_bound(struct skiplist *sl, struct skiplist_node *node, int bound, struct skiplist *out){
+        if(0 != out->busy || out->maxlevel < sl->level) return SKIPLIST_ERR;
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }, *lasts[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, }, last_ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        SKIPLIST_TRACK_RANK_BOUND(sl, node, bound, tracks, ranks);
+        int below = ranks[0], tail = sl->busy - below, i = 0;
+        if(0 == tail) return SKIPLIST_OK;
+        skiplist_track_last(sl, lasts, last_ranks);
+        struct skiplist_node *first = tracks[0]->link[0].next, *last = sl->header->prev;
+    #ifdef SKIPLIST_STATS
+        struct skiplist_node *pos = first;
+        for(; sl->header != pos; pos = pos->link[0].next){ //the histogram follows the nodes, a walk in stats builds only
+            SKIPLIST_STAT_ADD(sl, levels[pos->level], -1);
+            SKIPLIST_STAT_ADD(out, levels[pos->level], 1);
+        }
+    #endif
+        for(; i < sl->level; i++){
+            struct skiplist_node *next_node = tracks[i]->link[i].next;
+            if(sl->header == next_node){ //no tail node this high
+                out->header->link[i].next = out->header;
+                out->header->link[i].span = tail + 1;
+            }else{
+                out->header->link[i].next = next_node;
+                out->header->link[i].span = ranks[i] + tracks[i]->link[i].span - below;
+                lasts[i]->link[i].next = out->header; //its span already runs to the end
+            }
+            tracks[i]->link[i].next = sl->header;
+            tracks[i]->link[i].span = below + 1 - ranks[i];
+        }
+        first->prev = out->header;
+        out->header->prev = last;
+        sl->header->prev = tracks[0];
+        out->level = sl->level;
+        out->busy = tail;
+        sl->busy = below;
+        skiplist_shrink(sl);
+        skiplist_shrink(out);
+        sl->version += 1;
+        out->version += 1;
+        return SKIPLIST_OK;
+    }
+
+    //moves the nodes >= 'node' into the empty list 'out'
+    static inline int skiplist_split(struct skiplist *sl, struct skiplist_node *node, struct skiplist *out){
+        return skiplist_split_bound(sl, node, 0, out);
+    }
+
+    //appends every node of 'other', all above the last node of 'sl', and leaves 'other' empty
+    static inline int skiplist_join(struct skiplist *sl, struct skiplist *other){
+        if(0 == other->busy) return SKIPLIST_OK;
+        if(other->level > sl->maxlevel ||
+                (0 != sl->busy && 0 <= sl->cmp_item(sl->header->prev, other->header->link[0].next))){
+            return SKIPLIST_ERR;
+        }
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }, *lasts[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, }, last_ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        int level = sl->level > other->level ? sl->level : other->level, i = 0;
+        skiplist_track_last(sl, tracks, ranks);
+        skiplist_track_last(other, lasts, last_ranks);
+        for(; i < level; i++){
+            if(i >= sl->level){ //the list grows, the new levels start from the header
+                tracks[i] = sl->header;
+                ranks[i] = 0;
+            }
+            if(i >= other->level){
+                tracks[i]->link[i].span = sl->busy + other->busy + 1 - ranks[i];
+            }else{
+                tracks[i]->link[i].next = other->header->link[i].next;
+                tracks[i]->link[i].span = sl->busy + other->header->link[i].span - ranks[i];
+                lasts[i]->link[i].next = sl->header; //its span already runs to the end
+            }
+        }
+        other->header->link[0].next->prev = sl->header->prev;
+        sl->header->prev = other->header->prev;
+    #ifdef SKIPLIST_STATS
+        for(i = 0; i <= SKIPLIST_MAXLEVEL; i++){
+            SKIPLIST_STAT_ADD(sl, levels[i], other->stats.levels[i]);
+        }
+    #endif
+        sl->busy += other->busy;
+        sl->level = level;
+        sl->version += 1;
+        skiplist_destroy(other);
+        return SKIPLIST_OK;
+    }
+
+    //moves the nodes in ['lo', 'hi'] into the empty list 'out', a NULL bound is open
+    static inline int skiplist_range_delete(struct skiplist *sl, struct skiplist_node *lo, struct skiplist_node *hi, struct skiplist *out){
+        if(0 != out->busy || out->maxlevel < sl->level) return SKIPLIST_ERR;
+        if(NULL != lo && NULL != hi && 0 < sl->cmp_item(lo, hi)) return SKIPLIST_OK;
+        if(NULL == lo){
+            skiplist_join(out, sl);
+        }else{
+            skiplist_split_bound(sl, lo, 0, out);
+        }
+        if(NULL != hi){ //hand back what lies above 'hi'
+            struct skiplist rest;
+            skiplist_init_maxlevel(&rest, sl->cmp_item, sl->maxlevel);
+            skiplist_split_bound(out, hi, 1, &rest);
+            skiplist_join(sl, &rest);
+        }
+        return SKIPLIST_OK;
+    }
+
+    //appends 'n' nodes, strictly ascending and above the current last node, in one left-to-right pass
+    //keeping the last node of every level; out of order input is rejected before anything is linked
+    static inline int skiplist_bulk_load(struct skiplist *sl, struct skiplist_node **nodes, int n){
+        struct skiplist_node *last = sl->header->prev;
+        int i = 0;
+        for(; i < n; i++){
+            struct skiplist_node *prev = i > 0 ? nodes[i - 1] : last;
+            if(!SKIPLIST_NODE_FITS(sl, nodes[i]) || (sl->header != prev && 0 <= sl->cmp_item(prev, nodes[i]))){
+                return SKIPLIST_ERR;
+            }
+        }
+
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        struct skiplist_node *tmp_node = sl->header;
+        int rank = 0, l = sl->level - 1;
+        for(; l >= 0; l--){ //the last node of every level
+            while(tmp_node->link[l].next != sl->header){
+                rank += tmp_node->link[l].span;
+                tmp_node = tmp_node->link[l].next;
+            }
+            tracks[l] = tmp_node;
+            ranks[l] = rank;
+        }
+
+        for(i = 0; i < n; i++){
+            struct skiplist_node *node = nodes[i];
+            int node_rank = sl->busy + i + 1;
+            for(l = sl->level; l < node->level; l++){ //new levels start from the header
+                tracks[l] = sl->header;
+                ranks[l] = 0;
+            }
+            if(node->level > sl->level){
+                SKIPLIST_STORE(sl->level, node->level);
+            }
+            node->prev = last;
+            SKIPLIST_STAT_ADD(sl, levels[node->level], 1);
+            for(l = 0; l < node->level; l++){
+                node->link[l].next = sl->header;
+                node->link[l].span = 1;
+                tracks[l]->link[l].span = node_rank - ranks[l];
+                SKIPLIST_STORE(tracks[l]->link[l].next, node);
+                tracks[l] = node;
+                ranks[l] = node_rank;
+            }
+            last = node;
+        }
+
+        SKIPLIST_STAT_ADD(sl, puts, n);
+        sl->busy += n;
+        for(l = 0; l < sl->level; l++){ //spans of the last node of every level run to the end
+            tracks[l]->link[l].span = sl->busy + 1 - ranks[l];
+        }
+        SKIPLIST_STORE(sl->header->prev, last);
+        sl->version += 1;
+        return SKIPLIST_OK;
+    }
+
+    //copies the counters of 'sl' into 'stats' along with its size and height. Without SKIPLIST_STATS only
+    //the level histogram is filled in, by a walk along level 0, and SKIPLIST_ERR says nothing else was counted
+    static inline int skiplist_stats(struct skiplist *sl, struct skiplist_stats *stats){
+        int res = SKIPLIST_OK;
+    #ifdef SKIPLIST_STATS
+        *stats = sl->stats;
+    #else
+        struct skiplist_node *pos = sl->header->link[0].next;
+        *stats = (struct skiplist_stats){ 0 };
+        for(; pos != sl->header; pos = pos->link[0].next){
+            stats->levels[pos->level] += 1;
+        }
+        res = SKIPLIST_ERR;
+    #endif
+        stats->busy = sl->busy;
+        stats->level = sl->level;
+        stats->maxlevel = sl->maxlevel;
+        return res;
+    }
+
+    //zeroes the counters, the level histogram keeps tracking the live nodes
+    static inline void skiplist_stats_reset(struct skiplist *sl){
+    #ifdef SKIPLIST_STATS
+        int i = 0;
+        for(; i < SKIPLIST_MAXLEVEL; i++){
+            sl->stats.hops[i] = 0;
+        }
+        sl->stats.searches = sl->stats.cmps = 0;
+        sl->stats.puts = sl->stats.gets = sl->stats.dels = 0;
+    #else
+        (void)sl;
+    #endif
+    }
+
+    static inline void skiplist_finger_init(struct skiplist_finger *finger){
+        finger->valid = 0;
+    }
+
+    //moves the finger onto the predecessors of 'node': it climbs from the old position only as far as the
+    //key is away and descends from there, a stale finger or one already past the key restarts at the header
+    static inline void skiplist_finger_track(struct skiplist *sl, struct skiplist_finger *finger, struct skiplist_node *node){
+        struct skiplist_node **tracks = finger->tracks;
+        int *ranks = finger->ranks;
+        if(!finger->valid || finger->version != sl->version ||
+                (sl->header != tracks[0] && 0 <= sl->cmp_item(tracks[0], node))){
+            SKIPLIST_TRACK_RANK(sl, node, tracks, ranks);
+            finger->valid = 1;
+            finger->version = sl->version;
+            return;
+        }
+        int i = 0;
+        for(; i + 1 < sl->level; i++){ //levels above stay correct once their next node is not below the key
+            struct skiplist_node *next_node = tracks[i + 1]->link[i + 1].next;
+            if(sl->header == next_node || 0 <= sl->cmp_item(next_node, node)) break;
+        }
+        struct skiplist_node *tmp_node = tracks[i], *next_node = NULL;
+        int rank = ranks[i];
+        SKIPLIST_STAT_ADD(sl, searches, 1);
+        for(; i >= 0; i--){
+            if(ranks[i] > rank){ //the old track on this level is already further right
+                tmp_node = tracks[i];
+                rank = ranks[i];
+            }
+            while((next_node = tmp_node->link[i].next) != sl->header &&
+                    (SKIPLIST_STAT_ADD(sl, cmps, 1), 0 > sl->cmp_item(next_node, node))){
+                SKIPLIST_STAT_ADD(sl, hops[i], 1);
+                rank += tmp_node->link[i].span;
+                tmp_node = next_node;
+            }
+            tracks[i] = tmp_node;
+            ranks[i] = rank;
+        }
+    }
+
+    static inline int skiplist_put_hint(struct skiplist *sl, struct skiplist_finger *finger, struct skiplist_node *new_node){
+        if(!SKIPLIST_NODE_FITS(sl, new_node)) return SKIPLIST_ERR;
+        skiplist_finger_track(sl, finger, new_node);
+        struct skiplist_node *existing_node = finger->tracks[0]->link[0].next;
+        if(sl->header == existing_node || 0 != sl->cmp_item(existing_node, new_node)){
+            skiplist_link(sl, finger->tracks, finger->ranks, new_node);
+            int i = 0, rank = finger->ranks[0] + 1;
+            for(; i < new_node->level; i++){ //step onto the new node, the next key is usually right after it
+                finger->tracks[i] = new_node;
+                finger->ranks[i] = rank;
+            }
+            finger->version = sl->version;
             return SKIPLIST_OK;
         }
         return SKIPLIST_ERR;
     }
 
+    static inline int skiplist_upsert_hint(struct skiplist *sl, struct skiplist_finger *finger, struct skiplist_node *new_node,
+                                            struct skiplist_node **old_node){
+        *old_node = NULL;
+        if(!SKIPLIST_NODE_FITS(sl, new_node)) return SKIPLIST_ERR;
+        skiplist_finger_track(sl, finger, new_node);
+        struct skiplist_node *existing_node = finger->tracks[0]->link[0].next;
+        if(sl->header == existing_node || 0 != sl->cmp_item(existing_node, new_node)){
+            skiplist_link(sl, finger->tracks, finger->ranks, new_node);
+        }else{
+            skiplist_swap(sl, finger->tracks, finger->ranks, existing_node, new_node);
+            *old_node = existing_node;
+        }
+        int i = 0, rank = finger->ranks[0] + 1;
+        for(; i < new_node->level; i++){ //step onto the new node, as skiplist_put_hint does
+            finger->tracks[i] = new_node;
+            finger->ranks[i] = rank;
+        }
+        finger->version = sl->version;
+        return SKIPLIST_OK;
+    }
+
+    static inline struct skiplist_node *skiplist_get_hint(struct skiplist *sl, struct skiplist_finger *finger, struct skiplist_node *node){
+        SKIPLIST_STAT_ADD(sl, gets, 1);
+        skiplist_finger_track(sl, finger, node);
+        struct skiplist_node *existing_node = finger->tracks[0]->link[0].next;
+        if(sl->header != existing_node && 0 == sl->cmp_item(existing_node, node)){
+            return existing_node;
+        }
+        return NULL;
+    }
+
+    static inline struct skiplist_node *skiplist_remove_hint(struct skiplist *sl, struct skiplist_finger *finger, struct skiplist_node *node){
+        skiplist_finger_track(sl, finger, node);
+        struct skiplist_node *existing_node = finger->tracks[0]->link[0].next;
+        if(sl->header != existing_node && 0 == sl->cmp_item(existing_node, node)){
+            skiplist_unlink(sl, finger->tracks, existing_node); //the tracks stay in front of the gap
+            finger->version = sl->version;
+            return existing_node;
+        }
+        return NULL;
+    }
+
+    //set operations between lists ordered alike: nodes move from list to list and are never freed. A finger
+    //per list follows the walk, so every step costs O(log d) in the distance d from the previous key
+
+    //moves the nodes of 'other' whose keys 'sl' lacks into 'sl', 'other' keeps the duplicates and any tower
+    //too tall for 'sl'; O(m log(n/m))
+    //for m nodes in 'other', and O(log n) through skiplist_join when 'other' lies wholly above 'sl'
+    static inline void skiplist_union(struct skiplist *sl, struct skiplist *other){
+        if(0 == other->busy) return;
+        if((0 == sl->busy || 0 > sl->cmp_item(sl->header->prev, other->header->link[0].next)) &&
+                SKIPLIST_OK == skiplist_join(sl, other)){
+            return;
+        }
+        struct skiplist_finger finger, other_finger;
+        struct skiplist_node *pos = other->header->link[0].next, *next = NULL;
+        skiplist_finger_init(&finger);
+        skiplist_finger_init(&other_finger);
+        for(; other->header != pos; pos = next){
+            next = pos->link[0].next;
+            if(!SKIPLIST_NODE_FITS(sl, pos) || NULL != skiplist_get_hint(sl, &finger, pos)) continue;
+            skiplist_remove_hint(other, &other_finger, pos);
+            skiplist_put_hint(sl, &finger, pos);
+        }
+    }
+
+    //moves the nodes of 'sl' whose keys are in 'other' into the empty list 'out', O(m log(n/m)) for m nodes in 'other'
+    static inline int skiplist_difference(struct skiplist *sl, struct skiplist *other, struct skiplist *out){
+        if(0 != out->busy || out->maxlevel < sl->level) return SKIPLIST_ERR;
+        struct skiplist_finger finger, out_finger;
+        struct skiplist_node *pos = NULL, *iter = NULL, *node = NULL;
+        skiplist_finger_init(&finger);
+        skiplist_finger_init(&out_finger);
+        SKIPLIST_FOREACH_NEXT(other, pos, iter){
+            if(NULL != (node = skiplist_remove_hint(sl, &finger, pos))){
+                skiplist_put_hint(out, &out_finger, node); //appends, the finger stays at the end
+            }
+        }
+        return SKIPLIST_OK;
+    }
+
+    //moves the nodes of 'sl' whose keys 'other' lacks into the empty list 'out', one pass over 'sl'
+    static inline int skiplist_intersection(struct skiplist *sl, struct skiplist *other, struct skiplist *out){
+        if(0 != out->busy || out->maxlevel < sl->level) return SKIPLIST_ERR;
+        struct skiplist_finger finger, other_finger, out_finger;
+        struct skiplist_node *pos = sl->header->link[0].next, *next = NULL;
+        skiplist_finger_init(&finger);
+        skiplist_finger_init(&other_finger);
+        skiplist_finger_init(&out_finger);
+        for(; sl->header != pos; pos = next){
+            next = pos->link[0].next;
+            if(NULL != skiplist_get_hint(other, &other_finger, pos)) continue;
+            skiplist_remove_hint(sl, &finger, pos);
+            skiplist_put_hint(out, &out_finger, pos);
+        }
+        return SKIPLIST_OK;
+    }
+
+    //type-specialized front end: SKIPLIST_DEFINE(name, type, member, cmp) emits name_init, name_put,
+    //name_upsert, name_get, name_remove and name_seek_ge/gt/le/lt over 'type' items whose node is 'member'.
+    //'cmp' is a function or macro taking two 'type *' and is inlined into every search instead of being
+    //called through sl->cmp_item. The list stays a plain struct skiplist, so the generic calls still work
+    #define SKIPLIST_DEFINE(name, type, member, cmp) \
+        static inline int name##_cmp_node(void *k1, void *k2){ \
+            return cmp(skiplist_entry(k1, type, member), skiplist_entry(k2, type, member)); \
+        } \
+        \
+        static inline void name##_init(struct skiplist *sl){ \
+            skiplist_init(sl, name##_cmp_node); \
+        } \
+        \
+        static inline int name##_put(struct skiplist *sl, type *item){ \
+            if(!SKIPLIST_NODE_FITS(sl, &item->member)) return SKIPLIST_ERR; \
+            struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            int ranks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            SKIPLIST_TRACK_RANK_CMP_BOUND(sl, &item->member, 0, tracks, ranks, name##_cmp_node); \
+            struct skiplist_node *existing_node = tracks[0]->link[0].next; \
+            if(sl->header == existing_node || 0 != name##_cmp_node(existing_node, &item->member)){ \
+                skiplist_link(sl, tracks, ranks, &item->member); \
+                return SKIPLIST_OK; \
+            } \
+            return SKIPLIST_ERR; \
+        } \
+        \
+        static inline int name##_upsert(struct skiplist *sl, type *item, type **old_item){ \
+            *old_item = NULL; \
+            if(!SKIPLIST_NODE_FITS(sl, &item->member)) return SKIPLIST_ERR; \
+            struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            int ranks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            SKIPLIST_TRACK_RANK_CMP_BOUND(sl, &item->member, 0, tracks, ranks, name##_cmp_node); \
+            struct skiplist_node *existing_node = tracks[0]->link[0].next; \
+            if(sl->header == existing_node || 0 != name##_cmp_node(existing_node, &item->member)){ \
+                skiplist_link(sl, tracks, ranks, &item->member); \
+            }else{ \
+                skiplist_swap(sl, tracks, ranks, existing_node, &item->member); \
+                *old_item = skiplist_entry(existing_node, type, member); \
+            } \
+            return SKIPLIST_OK; \
+        } \
+        \
+        static inline type *name##_get(struct skiplist *sl, type *key){ \
+            struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            SKIPLIST_STAT_ADD(sl, gets, 1); \
+            SKIPLIST_TRACK_CMP_BOUND(sl, &key->member, 0, tracks, name##_cmp_node); \
+            struct skiplist_node *existing_node = SKIPLIST_LOAD(tracks[0]->link[0].next); \
+            if(sl->header != existing_node && 0 == name##_cmp_node(existing_node, &key->member)){ \
+                return skiplist_entry(existing_node, type, member); \
+            } \
+            return NULL; \
+        } \
+        \
+        static inline type *name##_remove(struct skiplist *sl, type *key){ \
+            struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            SKIPLIST_TRACK_CMP_BOUND(sl, &key->member, 0, tracks, name##_cmp_node); \
+            struct skiplist_node *existing_node = tracks[0]->link[0].next; \
+            if(sl->header != existing_node && 0 == name##_cmp_node(existing_node, &key->member)){ \
+                skiplist_unlink(sl, tracks, existing_node); \
+                return skiplist_entry(existing_node, type, member); \
+            } \
+            return NULL; \
+        } \
+        \
+        static inline struct skiplist_node *name##_floor(struct skiplist *sl, type *key, int bound){ \
+            struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, }; \
+            SKIPLIST_TRACK_CMP_BOUND(sl, &key->member, bound, tracks, name##_cmp_node); \
+            return tracks[0]; \
+        } \
+        \
+        static inline type *name##_seek_ge(struct skiplist *sl, type *key){ \
+            struct skiplist_node *res = SKIPLIST_LOAD(name##_floor(sl, key, 0)->link[0].next); \
+            return sl->header != res ? skiplist_entry(res, type, member) : NULL; \
+        } \
+        \
+        static inline type *name##_seek_gt(struct skiplist *sl, type *key){ \
+            struct skiplist_node *res = SKIPLIST_LOAD(name##_floor(sl, key, 1)->link[0].next); \
+            return sl->header != res ? skiplist_entry(res, type, member) : NULL; \
+        } \
+        \
+        static inline type *name##_seek_le(struct skiplist *sl, type *key){ \
+            struct skiplist_node *res = name##_floor(sl, key, 1); \
+            return sl->header != res ? skiplist_entry(res, type, member) : NULL; \
+        } \
+        \
+        static inline type *name##_seek_lt(struct skiplist *sl, type *key){ \
+            struct skiplist_node *res = name##_floor(sl, key, 0); \
+            return sl->header != res ? skiplist_entry(res, type, member) : NULL; \
+        }
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,175 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_ARENA__
+#define __SKIPLIST_ARENA__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdlib.h>
+    #include <stddef.h>
+    #include <string.h>
+
+    #include "skiplist.h"
+
+    //per-list arena: blocks are carved from big chunks in power of two size classes, freed blocks go to a
+    //free list of their class and are reused. Nothing is returned to malloc before skiplist_arena_destroy,
+    //which drops every chunk at once, so a list living in an arena is torn down without visiting its nodes:
+    //skiplist_destroy the list, then skiplist_arena_destroy the arena. Not thread safe, one arena per list
+
+    #define SKIPLIST_ARENA_MIN_SHIFT 4 //16 bytes, enough for the free list link
+    #define SKIPLIST_ARENA_CLASSES 9   //16 bytes .. 4KB, bigger blocks get a chunk of their own
+    #ifndef SKIPLIST_ARENA_CHUNK
+    #define SKIPLIST_ARENA_CHUNK (1 << 20)
+    #endif
+
+    struct skiplist_arena_chunk{
+        struct skiplist_arena_chunk *next;
+        size_t size;
+        size_t used;
+        size_t pad; //keeps data 16 byte aligned
+        char data[];
+    };
+
+    struct skiplist_arena{
+        size_t chunk_size;
+        size_t bytes;   //handed out and not freed, rounded up to the classes
+        size_t chunk_bytes;
+        struct skiplist_arena_chunk *chunks; //the first one is being carved
+        struct skiplist_arena_chunk *large;
+        void *free_list[SKIPLIST_ARENA_CLASSES];
+    };
+
+    static inline void skiplist_arena_init(struct skiplist_arena *arena, size_t chunk_size){
+        memset(arena, 0, sizeof(*arena));
+        arena->chunk_size = chunk_size > 0 ? chunk_size : SKIPLIST_ARENA_CHUNK;
+    }
+
+    //size class of 'size', SKIPLIST_ARENA_CLASSES if it is too big for one
+    static inline int skiplist_arena_class(size_t size){
+        int c = 0;
+        while(c < SKIPLIST_ARENA_CLASSES && ((size_t)1 << (c + SKIPLIST_ARENA_MIN_SHIFT)) < size){
+            c += 1;
+        }
+        return c;
+    }
+
+    //zeroed block of at least 'size' bytes
+    static inline void *skiplist_arena_alloc(struct skiplist_arena *arena, size_t size){
+        int c = skiplist_arena_class(size);
+        if(SKIPLIST_ARENA_CLASSES == c){
+            struct skiplist_arena_chunk *chunk = (struct skiplist_arena_chunk *)calloc(1, sizeof(*chunk) + size);
+            if(NULL == chunk) return NULL;
+            chunk->size = chunk->used = size;
+            chunk->next = arena->large;
+            arena->large = chunk;
+            arena->bytes += size;
+            arena->chunk_bytes += sizeof(*chunk) + size;
+            return chunk->data;
+        }
+        size_t block = (size_t)1 << (c + SKIPLIST_ARENA_MIN_SHIFT);
+        void *res = arena->free_list[c];
+        if(NULL != res){
+            arena->free_list[c] = *(void **)res;
+        }else{
+            struct skiplist_arena_chunk *chunk = arena->chunks;
+            if(NULL == chunk || chunk->used + block > chunk->size){ //the rest of the old chunk is left unused
+                size_t size = arena->chunk_size > block ? arena->chunk_size : block;
+                chunk = (struct skiplist_arena_chunk *)malloc(sizeof(*chunk) + size);
+                if(NULL == chunk) return NULL;
+                chunk->size = size;
+                chunk->used = 0;
+                chunk->next = arena->chunks;
+                arena->chunks = chunk;
+                arena->chunk_bytes += sizeof(*chunk) + size;
+            }
+            res = chunk->data + chunk->used;
+            chunk->used += block;
+        }
+        arena->bytes += block;
+        return memset(res, 0, block);
+    }
+
+    //'size' must be the size the block was allocated with
+    static inline void skiplist_arena_free(struct skiplist_arena *arena, void *ptr, size_t size){
+        if(NULL == ptr) return;
+        int c = skiplist_arena_class(size);
+        if(SKIPLIST_ARENA_CLASSES == c){
+            struct skiplist_arena_chunk **pos = &arena->large;
+            for(; NULL != *pos; pos = &(*pos)->next){
+                if((*pos)->data == (char *)ptr){
+                    struct skiplist_arena_chunk *chunk = *pos;
+                    *pos = chunk->next;
+                    arena->bytes -= chunk->size;
+                    arena->chunk_bytes -= sizeof(*chunk) + chunk->size;
+                    free(chunk);
+                    return;
+                }
+            }
+            return;
+        }
+        *(void **)ptr = arena->free_list[c];
+        arena->free_list[c] = ptr;
+        arena->bytes -= (size_t)1 << (c + SKIPLIST_ARENA_MIN_SHIFT);
+    }
+
+    static inline char *skiplist_arena_strdup(struct skiplist_arena *arena, const char *str){
+        size_t len = strlen(str) + 1;
+        char *res = (char *)skiplist_arena_alloc(arena, len);
+        if(NULL != res) memcpy(res, str, len);
+        return res;
+    }
+
+    //frees every chunk, whatever is still allocated from them
+    static inline void skiplist_arena_destroy(struct skiplist_arena *arena){
+        struct skiplist_arena_chunk *lists[2] = { arena->chunks, arena->large };
+        int i = 0;
+        for(; i < 2; i++){
+            struct skiplist_arena_chunk *chunk = lists[i];
+            while(NULL != chunk){
+                struct skiplist_arena_chunk *next = chunk->next;
+                free(chunk);
+                chunk = next;
+            }
+        }
+        skiplist_arena_init(arena, arena->chunk_size);
+    }
+
+    //first byte after the tower of 'node', where 'extra' bytes asked for at allocation start
+    static inline char *skiplist_node_tail(struct skiplist_node *node){
+        return (char *)&node->link[node->level];
+    }
+
+    //same as skiplist_node_alloc, from 'arena' and with 'extra' bytes after the tower for inline data
+    static inline void *skiplist_node_alloc_arena(struct skiplist *sl, struct skiplist_arena *arena,
+                                                    size_t size, size_t offset, size_t extra){
+        int level = skiplist_random_level(sl);
+        char *item = (char *)skiplist_arena_alloc(arena, skiplist_node_size(size, offset, level) + extra);
+        if(NULL == item) return NULL;
+        ((struct skiplist_node *)(item + offset))->level = level;
+        return item;
+    }
+
+    #define SKIPLIST_NODE_ALLOC_ARENA(sl, arena, type, member, extra) \
+        ((type *)skiplist_node_alloc_arena((sl), (arena), sizeof(type), offsetof(type, member), (extra)))
+
+#ifdef __cplusplus
+}
+#endif
+#endif
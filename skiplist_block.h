@@ -0,0 +1,302 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_BLOCK__
+#define __SKIPLIST_BLOCK__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdlib.h>
+    #include <stddef.h>
+    #include <limits.h>
+
+    #if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+    #endif
+
+    #include "skiplist.h"
+
+    //unrolled variant for int keys: every node holds up to BSKIPLIST_BLOCK sorted keys and their values,
+    //so a lookup touches a few wide nodes instead of one node per key. Links cache the first key of the
+    //node they point to, a descent reads only the towers it walks along and the one node it ends in.
+    //Nodes are owned by the list: split when full, merged with the next one when they run low
+
+    #ifndef BSKIPLIST_BLOCK
+    #define BSKIPLIST_BLOCK 16 //keys per node, a multiple of 8
+    #endif
+
+    struct bskiplist_node;
+    struct bskiplist_link{
+        struct bskiplist_node *next; //NULL at the end of a level
+        int key;                     //next->keys[0]
+    };
+
+    struct bskiplist_node{
+        int level;
+        int count;
+        int keys[BSKIPLIST_BLOCK];   //sorted, unused slots hold INT_MAX so the vector search can ignore 'count'
+        void *values[BSKIPLIST_BLOCK];
+        struct bskiplist_link link[];
+    };
+
+    struct bskiplist{
+        int busy;   //keys, not nodes
+        int nodes;
+        int level;
+        int maxlevel;
+        union{
+            struct bskiplist_node header[1];
+            char header_storage[sizeof(struct bskiplist_node) + SKIPLIST_MAXLEVEL * sizeof(struct bskiplist_link)];
+        };
+    };
+
+    #define BSKIPLIST_FOREACH(sl, pos) \
+        for ((pos) = (sl)->header->link[0].next; NULL != (pos); (pos) = (pos)->link[0].next)
+
+    static inline void bskiplist_init(struct bskiplist *sl){
+        sl->busy = 0;
+        sl->nodes = 0;
+        sl->level = 1;
+        sl->maxlevel = SKIPLIST_MAXLEVEL;
+        sl->header->level = SKIPLIST_MAXLEVEL;
+        sl->header->count = 0;
+        int i = 0;
+        for(; i < SKIPLIST_MAXLEVEL; i++){
+            sl->header->link[i].next = NULL;
+            sl->header->link[i].key = INT_MAX;
+        }
+    }
+
+    static inline struct bskiplist_node *bskiplist_node_alloc(struct bskiplist *sl){
+        int level = SKIPLIST_RANDOM_LEVEL(sl->maxlevel), i = 0;
+        struct bskiplist_node *node = (struct bskiplist_node *)malloc(sizeof(*node) + level * sizeof(struct bskiplist_link));
+        if(NULL == node) return NULL;
+        node->level = level;
+        node->count = 0;
+        for(; i < BSKIPLIST_BLOCK; i++){
+            node->keys[i] = INT_MAX;
+        }
+        return node;
+    }
+
+    //number of keys in 'node' below 'key', that is the slot 'key' has or would take
+    static inline int bskiplist_node_rank(struct bskiplist_node *node, int key){
+        int rank = 0, i = 0;
+    #if defined(__AVX2__)
+        __m256i probe = _mm256_set1_epi32(key);
+        for(; i < BSKIPLIST_BLOCK; i += 8){
+            __m256i gt = _mm256_cmpgt_epi32(probe, _mm256_loadu_si256((__m256i *)(node->keys + i)));
+            rank += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+        }
+    #elif defined(__SSE2__)
+        __m128i probe = _mm_set1_epi32(key);
+        for(; i < BSKIPLIST_BLOCK; i += 4){
+            __m128i gt = _mm_cmpgt_epi32(probe, _mm_loadu_si128((__m128i *)(node->keys + i)));
+            rank += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(gt)));
+        }
+    #else
+        for(; i < BSKIPLIST_BLOCK; i++){
+            rank += node->keys[i] < key;
+        }
+    #endif
+        return rank;
+    }
+
+    //tracks[i] is the last node on level i whose first key is below 'key', the header if none
+    static inline void bskiplist_track(struct bskiplist *sl, int key, struct bskiplist_node **tracks){
+        struct bskiplist_node *tmp_node = sl->header;
+        int i = sl->level - 1;
+        for(; i >= 0; i--){
+            while(NULL != tmp_node->link[i].next && tmp_node->link[i].key < key){
+                tmp_node = tmp_node->link[i].next;
+            }
+            tracks[i] = tmp_node;
+        }
+    }
+
+    //links 'new_node' right after 'node', the predecessor on a level 'node' does not reach is tracks[i]
+    static inline void bskiplist_link_after(struct bskiplist *sl, struct bskiplist_node **tracks,
+                                            struct bskiplist_node *node, struct bskiplist_node *new_node){
+        int i = sl->level;
+        for(; i < new_node->level; i++){
+            tracks[i] = sl->header;
+        }
+        if(new_node->level > sl->level){
+            sl->level = new_node->level;
+        }
+        for(i = 0; i < new_node->level; i++){
+            struct bskiplist_node *p = i < node->level ? node : tracks[i];
+            new_node->link[i] = p->link[i];
+            p->link[i].next = new_node;
+            p->link[i].key = new_node->keys[0];
+        }
+        sl->nodes += 1;
+    }
+
+    //unlinks 'del_node', whose predecessors are found the same way
+    static inline void bskiplist_unlink_after(struct bskiplist *sl, struct bskiplist_node **tracks,
+                                                struct bskiplist_node *node, struct bskiplist_node *del_node){
+        int i = 0;
+        for(; i < del_node->level; i++){
+            struct bskiplist_node *p = i < node->level ? node : tracks[i];
+            p->link[i] = del_node->link[i];
+        }
+        while(sl->level > 1 && NULL == sl->header->link[sl->level - 1].next){
+            sl->level -= 1;
+        }
+        sl->nodes -= 1;
+    }
+
+    static inline int bskiplist_get(struct bskiplist *sl, int key, void **value){
+        struct bskiplist_node *tracks[SKIPLIST_MAXLEVEL];
+        bskiplist_track(sl, key, tracks);
+        struct bskiplist_node *node = tracks[0];
+        if(NULL != node->link[0].next && node->link[0].key == key){ //first key of the next node
+            *value = node->link[0].next->values[0];
+            return SKIPLIST_OK;
+        }
+        if(sl->header == node) return SKIPLIST_ERR;
+        int rank = bskiplist_node_rank(node, key);
+        if(rank < node->count && node->keys[rank] == key){
+            *value = node->values[rank];
+            return SKIPLIST_OK;
+        }
+        return SKIPLIST_ERR;
+    }
+
+    //inserts 'key' or overwrites its value
+    static inline int bskiplist_put(struct bskiplist *sl, int key, void *value){
+        struct bskiplist_node *tracks[SKIPLIST_MAXLEVEL];
+        bskiplist_track(sl, key, tracks);
+        struct bskiplist_node *node = tracks[0], *next = node->link[0].next;
+        if(NULL != next && node->link[0].key == key){
+            next->values[0] = value;
+            return SKIPLIST_OK;
+        }
+        if(sl->header == node){ //below every key, the first node takes it
+            node = next;
+            if(NULL == node){
+                if(NULL == (node = bskiplist_node_alloc(sl))) return SKIPLIST_ERR;
+                node->keys[0] = key;
+                node->values[0] = value;
+                node->count = 1;
+                bskiplist_link_after(sl, tracks, sl->header, node);
+                sl->busy += 1;
+                return SKIPLIST_OK;
+            }
+        }
+        int rank = bskiplist_node_rank(node, key);
+        if(rank < node->count && node->keys[rank] == key){
+            node->values[rank] = value;
+            return SKIPLIST_OK;
+        }
+        if(BSKIPLIST_BLOCK == node->count){ //split, the upper part moves to a new node
+            struct bskiplist_node *new_node = bskiplist_node_alloc(sl);
+            if(NULL == new_node) return SKIPLIST_ERR;
+            //appending past the last key fills nodes up instead of leaving them half empty
+            int split = (BSKIPLIST_BLOCK == rank && NULL == next) ? BSKIPLIST_BLOCK - 1 : BSKIPLIST_BLOCK / 2, i = split;
+            for(; i < BSKIPLIST_BLOCK; i++){
+                new_node->keys[i - split] = node->keys[i];
+                new_node->values[i - split] = node->values[i];
+                node->keys[i] = INT_MAX;
+            }
+            new_node->count = BSKIPLIST_BLOCK - split;
+            node->count = split;
+            bskiplist_link_after(sl, tracks, node, new_node);
+            if(rank > split){
+                node = new_node;
+                rank -= split;
+            }
+        }
+        int i = node->count;
+        for(; i > rank; i--){
+            node->keys[i] = node->keys[i - 1];
+            node->values[i] = node->values[i - 1];
+        }
+        node->keys[rank] = key;
+        node->values[rank] = value;
+        node->count += 1;
+        if(0 == rank){ //new first key, only the first node can get one and its predecessors are the header
+            for(i = 0; i < node->level; i++){
+                tracks[i]->link[i].key = key;
+            }
+        }
+        sl->busy += 1;
+        return SKIPLIST_OK;
+    }
+
+    //removes 'key', '*value' receives its value
+    static inline int bskiplist_del(struct bskiplist *sl, int key, void **value){
+        struct bskiplist_node *tracks[SKIPLIST_MAXLEVEL];
+        bskiplist_track(sl, key, tracks);
+        struct bskiplist_node *node = tracks[0], *next = node->link[0].next;
+        int rank = 0, i = 0;
+        if(NULL != next && node->link[0].key == key){ //first key of the next node, tracks are its predecessors
+            node = next;
+        }else{
+            if(sl->header == node) return SKIPLIST_ERR;
+            rank = bskiplist_node_rank(node, key);
+            if(rank >= node->count || node->keys[rank] != key) return SKIPLIST_ERR;
+        }
+        *value = node->values[rank];
+        node->count -= 1;
+        for(i = rank; i < node->count; i++){
+            node->keys[i] = node->keys[i + 1];
+            node->values[i] = node->values[i + 1];
+        }
+        node->keys[node->count] = INT_MAX;
+        sl->busy -= 1;
+        if(0 == node->count){ //only a node entered through its first key can run empty
+            bskiplist_unlink_after(sl, tracks, tracks[0], node);
+            free(node);
+            return SKIPLIST_OK;
+        }
+        if(0 == rank){
+            for(i = 0; i < node->level; i++){
+                tracks[i]->link[i].key = node->keys[0];
+            }
+        }
+        next = node->link[0].next;
+        if(node->count <= BSKIPLIST_BLOCK / 4 && NULL != next && node->count + next->count <= BSKIPLIST_BLOCK / 2){
+            for(i = 0; i < next->count; i++){ //merge the next node in
+                node->keys[node->count + i] = next->keys[i];
+                node->values[node->count + i] = next->values[i];
+            }
+            node->count += next->count;
+            bskiplist_unlink_after(sl, tracks, node, next);
+            free(next);
+        }
+        return SKIPLIST_OK;
+    }
+
+    //frees every node, the values are left to the caller
+    static inline void bskiplist_destroy(struct bskiplist *sl){
+        struct bskiplist_node *pos = sl->header->link[0].next;
+        while(NULL != pos){
+            struct bskiplist_node *next = pos->link[0].next;
+            free(pos);
+            pos = next;
+        }
+        bskiplist_init(sl);
+    }
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,144 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_EPOCH__
+#define __SKIPLIST_EPOCH__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdlib.h>
+
+    //epoch based reclamation: a retired entry is freed once every thread has left the epoch it was retired in
+
+    #define SKIPLIST_EPOCH_ACTIVE 1UL
+    #define SKIPLIST_EPOCH_ADVANCE 64 //retires between attempts to move the global epoch
+
+    struct skiplist_epoch_entry;
+    typedef void skiplist_epoch_free(struct skiplist_epoch_entry *entry);
+
+    //embed in anything that is retired, it holds the limbo link
+    struct skiplist_epoch_entry{
+        struct skiplist_epoch_entry *next;
+        skiplist_epoch_free *free_entry;
+    };
+
+    //one per thread, owned by the caller, registered once and kept alive until skiplist_epoch_destroy
+    struct skiplist_epoch_thread{
+        unsigned long local;                   //(epoch << 1) | SKIPLIST_EPOCH_ACTIVE while inside
+        int retired;
+        unsigned long limbo_epoch[3];
+        struct skiplist_epoch_entry *limbo[3]; //entries retired in epoch e wait in limbo[e % 3]
+        struct skiplist_epoch_thread *next;
+    };
+
+    struct skiplist_epoch{
+        unsigned long global;
+        struct skiplist_epoch_thread *threads;
+    };
+
+    static inline void skiplist_epoch_init(struct skiplist_epoch *epoch){
+        epoch->global = 0;
+        epoch->threads = NULL;
+    }
+
+    static inline void skiplist_epoch_register(struct skiplist_epoch *epoch, struct skiplist_epoch_thread *thr){
+        *thr = (struct skiplist_epoch_thread){ .local = 0 };
+        struct skiplist_epoch_thread *head = __atomic_load_n(&epoch->threads, __ATOMIC_ACQUIRE);
+        do{
+            thr->next = head;
+        }while(!__atomic_compare_exchange_n(&epoch->threads, &head, thr, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    }
+
+    static inline void skiplist_epoch_free_list(struct skiplist_epoch_entry *entry){
+        while(NULL != entry){
+            struct skiplist_epoch_entry *next = entry->next;
+            entry->free_entry(entry);
+            entry = next;
+        }
+    }
+
+    //frees every limbo list that is at least two epochs old
+    static inline void skiplist_epoch_collect(struct skiplist_epoch_thread *thr, unsigned long global){
+        int i = 0;
+        for(; i < 3; i++){
+            if(NULL != thr->limbo[i] && thr->limbo_epoch[i] + 2 <= global){
+                skiplist_epoch_free_list(thr->limbo[i]);
+                thr->limbo[i] = NULL;
+            }
+        }
+    }
+
+    //moves the global epoch forward if every active thread has observed it
+    static inline void skiplist_epoch_try_advance(struct skiplist_epoch *epoch){
+        unsigned long global = __atomic_load_n(&epoch->global, __ATOMIC_ACQUIRE);
+        struct skiplist_epoch_thread *thr = __atomic_load_n(&epoch->threads, __ATOMIC_ACQUIRE);
+        for(; NULL != thr; thr = thr->next){
+            unsigned long local = __atomic_load_n(&thr->local, __ATOMIC_ACQUIRE);
+            if((local & SKIPLIST_EPOCH_ACTIVE) && (local >> 1) != global){
+                return;
+            }
+        }
+        __atomic_compare_exchange_n(&epoch->global, &global, global + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    }
+
+    static inline void skiplist_epoch_enter(struct skiplist_epoch *epoch, struct skiplist_epoch_thread *thr){
+        unsigned long global = __atomic_load_n(&epoch->global, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&thr->local, (global << 1) | SKIPLIST_EPOCH_ACTIVE, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); //publish before touching shared nodes
+        skiplist_epoch_collect(thr, global);
+    }
+
+    static inline void skiplist_epoch_exit(struct skiplist_epoch_thread *thr){
+        __atomic_store_n(&thr->local, 0, __ATOMIC_RELEASE);
+    }
+
+    //'entry' must already be unreachable for threads entering from now on
+    static inline void skiplist_epoch_retire(struct skiplist_epoch *epoch, struct skiplist_epoch_thread *thr,
+                                                struct skiplist_epoch_entry *entry){
+        unsigned long e = __atomic_load_n(&epoch->global, __ATOMIC_ACQUIRE); //readers that saw it are at most in e
+        int i = e % 3;
+        if(NULL != thr->limbo[i] && thr->limbo_epoch[i] != e){ //an older epoch, at least three behind
+            skiplist_epoch_free_list(thr->limbo[i]);
+            thr->limbo[i] = NULL;
+        }
+        thr->limbo_epoch[i] = e;
+        entry->next = thr->limbo[i];
+        thr->limbo[i] = entry;
+        if(0 == ++thr->retired % SKIPLIST_EPOCH_ADVANCE){
+            skiplist_epoch_try_advance(epoch);
+        }
+    }
+
+    //frees every pending entry, no thread may be inside an epoch
+    static inline void skiplist_epoch_destroy(struct skiplist_epoch *epoch){
+        struct skiplist_epoch_thread *thr = epoch->threads;
+        for(; NULL != thr; thr = thr->next){
+            int i = 0;
+            for(; i < 3; i++){
+                skiplist_epoch_free_list(thr->limbo[i]);
+                thr->limbo[i] = NULL;
+            }
+        }
+        epoch->threads = NULL;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+#endif
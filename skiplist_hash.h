@@ -0,0 +1,195 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_HASH__
+#define __SKIPLIST_HASH__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdint.h>
+    #include <stdlib.h>
+
+    #include "skiplist.h"
+
+    //hash index beside a list: an open addressing table (linear probing) from key hash to node, so exact
+    //lookups skip the descent. The owner hashes the keys and keeps the index in step with every link and
+    //unlink. Growing never rehashes at once: the old table drains SKIPLIST_HASH_STEP slots per put or del
+    //while lookups check both. Same threading as the list's writer
+
+    #define SKIPLIST_HASH_MIN 16
+    #define SKIPLIST_HASH_STEP 32 //old slots moved per put or del while a resize runs
+    #define SKIPLIST_HASH_MOVED ((struct skiplist_node *)1) //a draining slot already moved or deleted
+
+    struct skiplist_hash_slot{
+        uint64_t hash;
+        struct skiplist_node *node; //NULL when empty
+    };
+
+    struct skiplist_hash_table{
+        struct skiplist_hash_slot *slots;
+        size_t mask;
+        size_t count;
+    };
+
+    struct skiplist_hash{
+        struct skiplist_hash_table table; //takes every insert
+        struct skiplist_hash_table old;   //draining into 'table', no slots when idle
+        size_t drain;                     //next old slot to move
+        skiplist_cmp_item *cmp_item;      //0 for the same key, as in the list
+    };
+
+    //multiply-fold mixing, for owners building their key hash a word at a time
+    static inline uint64_t skiplist_hash_mix(uint64_t a, uint64_t b){
+        __uint128_t m = (__uint128_t)(a ^ 0xA0761D6478BD642FULL) * (b ^ 0xE7037ED1A0B428DBULL);
+        return (uint64_t)(m >> 64) ^ (uint64_t)m;
+    }
+
+    static inline int skiplist_hash_table_init(struct skiplist_hash_table *t, size_t size){
+        t->slots = (struct skiplist_hash_slot *)calloc(size, sizeof(*t->slots));
+        t->mask = size - 1;
+        t->count = 0;
+        return NULL != t->slots ? SKIPLIST_OK : SKIPLIST_ERR;
+    }
+
+    //'capacity' is a hint of the keys to come
+    static inline int skiplist_hash_init(struct skiplist_hash *h, skiplist_cmp_item *cmp_item, size_t capacity){
+        size_t size = SKIPLIST_HASH_MIN;
+        while(size * 3 / 4 < capacity) size <<= 1;
+        h->old = (struct skiplist_hash_table){ 0 };
+        h->drain = 0;
+        h->cmp_item = cmp_item;
+        return skiplist_hash_table_init(&h->table, size);
+    }
+
+    static inline void skiplist_hash_destroy(struct skiplist_hash *h){
+        free(h->table.slots);
+        free(h->old.slots);
+        h->table = h->old = (struct skiplist_hash_table){ 0 };
+    }
+
+    static inline size_t skiplist_hash_count(struct skiplist_hash *h){
+        return h->table.count + h->old.count;
+    }
+
+    static inline void skiplist_hash_table_add(struct skiplist_hash_table *t, uint64_t hash, struct skiplist_node *node){
+        size_t i = hash & t->mask;
+        while(NULL != t->slots[i].node) i = (i + 1) & t->mask;
+        t->slots[i].hash = hash;
+        t->slots[i].node = node;
+        t->count += 1;
+    }
+
+    //slot of 'node' if given, else of the node equal to 'probe', NULL if absent
+    static inline struct skiplist_hash_slot *skiplist_hash_table_find(struct skiplist_hash *h, struct skiplist_hash_table *t,
+                                                    uint64_t hash, struct skiplist_node *node, struct skiplist_node *probe){
+        if(NULL == t->slots) return NULL;
+        size_t i = hash & t->mask;
+        struct skiplist_hash_slot *slot = NULL;
+        for(; NULL != (slot = &t->slots[i])->node; i = (i + 1) & t->mask){
+            if(slot->hash != hash || SKIPLIST_HASH_MOVED == slot->node) continue;
+            if(NULL != node ? node == slot->node : 0 == h->cmp_item(slot->node, probe)) return slot;
+        }
+        return NULL;
+    }
+
+    //empties a slot of the live table and shifts the rest of its run back, so probes need no tombstones
+    static inline void skiplist_hash_table_remove(struct skiplist_hash_table *t, struct skiplist_hash_slot *slot){
+        size_t i = slot - t->slots, j = i;
+        for(;;){
+            j = (j + 1) & t->mask;
+            if(NULL == t->slots[j].node) break;
+            size_t home = t->slots[j].hash & t->mask;
+            if(((j - home) & t->mask) >= ((j - i) & t->mask)){ //'i' still lies on the way from its home to 'j'
+                t->slots[i] = t->slots[j];
+                i = j;
+            }
+        }
+        t->slots[i].node = NULL;
+        t->count -= 1;
+    }
+
+    static inline void skiplist_hash_step(struct skiplist_hash *h, size_t steps){
+        for(; NULL != h->old.slots && steps > 0; steps--){
+            struct skiplist_hash_slot *slot = &h->old.slots[h->drain];
+            if(NULL != slot->node && SKIPLIST_HASH_MOVED != slot->node){
+                skiplist_hash_table_add(&h->table, slot->hash, slot->node);
+                slot->node = SKIPLIST_HASH_MOVED; //keeps the probe runs over it intact
+                h->old.count -= 1;
+            }
+            if(++h->drain > h->old.mask){ //drained
+                free(h->old.slots);
+                h->old = (struct skiplist_hash_table){ 0 };
+                h->drain = 0;
+            }
+        }
+    }
+
+    //the indexed node equal to 'probe', whose key hashes to 'hash'; NULL if absent
+    static inline struct skiplist_node *skiplist_hash_get(struct skiplist_hash *h, uint64_t hash, struct skiplist_node *probe){
+        struct skiplist_hash_slot *slot = skiplist_hash_table_find(h, &h->table, hash, NULL, probe);
+        if(NULL == slot) slot = skiplist_hash_table_find(h, &h->old, hash, NULL, probe);
+        return NULL != slot ? slot->node : NULL;
+    }
+
+    //indexes 'node', whose key must not be indexed yet; SKIPLIST_ERR if the table cannot grow
+    static inline int skiplist_hash_put(struct skiplist_hash *h, uint64_t hash, struct skiplist_node *node){
+        skiplist_hash_step(h, SKIPLIST_HASH_STEP);
+        if((h->table.count + 1) * 4 > (h->table.mask + 1) * 3){ //past 3/4, start a resize
+            struct skiplist_hash_table bigger;
+            skiplist_hash_step(h, (size_t)-1); //the previous one always ends long before, finish it if not
+            if(SKIPLIST_OK != skiplist_hash_table_init(&bigger, (h->table.mask + 1) * 2)){
+                if(h->table.count + 1 > h->table.mask) return SKIPLIST_ERR; //keeps one empty slot
+            }else{
+                h->old = h->table;
+                h->table = bigger;
+                h->drain = 0;
+            }
+        }
+        skiplist_hash_table_add(&h->table, hash, node);
+        return SKIPLIST_OK;
+    }
+
+    //points the entry of 'old_node' at 'new_node', which has the same key
+    static inline void skiplist_hash_replace(struct skiplist_hash *h, uint64_t hash, struct skiplist_node *old_node,
+                                                struct skiplist_node *new_node){
+        struct skiplist_hash_slot *slot = skiplist_hash_table_find(h, &h->table, hash, old_node, NULL);
+        if(NULL == slot) slot = skiplist_hash_table_find(h, &h->old, hash, old_node, NULL);
+        if(NULL != slot) slot->node = new_node;
+    }
+
+    //drops the entry of 'node'
+    static inline int skiplist_hash_del(struct skiplist_hash *h, uint64_t hash, struct skiplist_node *node){
+        struct skiplist_hash_slot *slot = skiplist_hash_table_find(h, &h->table, hash, node, NULL);
+        int res = SKIPLIST_OK;
+        if(NULL != slot){
+            skiplist_hash_table_remove(&h->table, slot);
+        }else if(NULL != (slot = skiplist_hash_table_find(h, &h->old, hash, node, NULL))){
+            slot->node = SKIPLIST_HASH_MOVED; //a draining table is never shifted, the drain walks it in order
+            h->old.count -= 1;
+        }else{
+            res = SKIPLIST_ERR;
+        }
+        skiplist_hash_step(h, SKIPLIST_HASH_STEP);
+        return res;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+#endif
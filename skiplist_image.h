@@ -0,0 +1,274 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_IMAGE__
+#define __SKIPLIST_IMAGE__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdio.h>
+    #include <stdint.h>
+    #include <string.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+
+    #include "skiplist.h"
+
+    //read-only image of a list: keys and values are copied next to their towers and links are file
+    //offsets, so a file mapped anywhere is searched in place. Towers are rebuilt perfectly balanced
+    //(skiplist_bulk_level) while writing. Images are native endian and trusted: opening checks the
+    //header and the size, not every offset
+
+    #define SKIPLIST_IMAGE_MAGIC 0x31474D494C50534BULL //"KSPLIMG1" read little endian
+    #define SKIPLIST_IMAGE_NULL_VALUE 1 //node flag, the value was NULL rather than empty
+
+    struct skiplist_image_header{
+        uint64_t magic;
+        uint64_t size;  //bytes in the image
+        uint64_t count; //nodes
+        uint32_t level;
+        uint32_t pad;
+        uint64_t head[SKIPLIST_MAXLEVEL]; //offset of the first node of every level, 0 past the end
+    };
+
+    //followed by the key bytes then the value bytes, the next node starts 8 byte aligned
+    struct skiplist_image_node{
+        uint32_t level;
+        uint32_t flags;
+        uint32_t key_len;
+        uint32_t value_len;
+        uint64_t next[];
+    };
+
+    //compares two keys the way the list that was written compares its nodes
+    typedef int skiplist_image_cmp(const void *k1, size_t l1, const void *k2, size_t l2);
+
+    struct skiplist_image{
+        const char *base;
+        size_t size;
+        int mapped; //base is an mmap of a file, skiplist_image_close unmaps it
+        skiplist_image_cmp *cmp;
+    };
+
+    //bytewise, a shorter key sorts before any longer key it is a prefix of; strcmp order for strings
+    static inline int skiplist_image_memcmp(const void *k1, size_t l1, const void *k2, size_t l2){
+        int res = memcmp(k1, k2, l1 < l2 ? l1 : l2);
+        if(0 != res) return res;
+        return (l1 > l2) - (l1 < l2);
+    }
+
+    //hands out the key and value of a node being written, SKIPLIST_ERR stops the write
+    typedef int skiplist_image_fields(struct skiplist_node *node, const void **key, size_t *key_len,
+                                        const void **value, size_t *value_len);
+
+    static inline size_t skiplist_image_node_size(int level, size_t key_len, size_t value_len){
+        size_t size = sizeof(struct skiplist_image_node) + level * sizeof(uint64_t) + key_len + value_len;
+        return (size + 7) & ~(size_t)7;
+    }
+
+    //the image of 'sl' in one malloc'd block of '*size' bytes, NULL on failure
+    static inline void *skiplist_image_build(struct skiplist *sl, skiplist_image_fields *fields, size_t *size){
+        struct skiplist_node *pos, *iter = NULL;
+        const void *key = NULL, *value = NULL;
+        size_t key_len = 0, value_len = 0, total = sizeof(struct skiplist_image_header);
+        int rank = 0, level = 1, i = 0;
+        SKIPLIST_FOREACH_NEXT(sl, pos, iter){
+            if(SKIPLIST_OK != fields(pos, &key, &key_len, &value, &value_len)) return NULL;
+            if(key_len > UINT32_MAX || value_len > UINT32_MAX) return NULL;
+            total += skiplist_image_node_size(skiplist_bulk_level(sl, ++rank), key_len, value_len);
+        }
+        char *base = (char *)calloc(1, total);
+        if(NULL == base) return NULL;
+
+        struct skiplist_image_header *header = (struct skiplist_image_header *)base;
+        uint64_t *last[SKIPLIST_MAXLEVEL]; //where the next node of every level gets linked from
+        for(; i < SKIPLIST_MAXLEVEL; i++){
+            last[i] = &header->head[i];
+        }
+        size_t offset = sizeof(*header);
+        rank = 0;
+        iter = NULL;
+        SKIPLIST_FOREACH_NEXT(sl, pos, iter){
+            struct skiplist_image_node *node = (struct skiplist_image_node *)(base + offset);
+            if(SKIPLIST_OK != fields(pos, &key, &key_len, &value, &value_len)) goto err;
+            node->level = skiplist_bulk_level(sl, ++rank);
+            node->flags = NULL == value ? SKIPLIST_IMAGE_NULL_VALUE : 0;
+            node->key_len = (uint32_t)key_len;
+            node->value_len = NULL == value ? 0 : (uint32_t)value_len;
+            size_t node_size = skiplist_image_node_size(node->level, node->key_len, node->value_len);
+            if(offset + node_size > total) goto err; //'fields' gave a different answer the second time
+            char *data = (char *)&node->next[node->level];
+            memcpy(data, key, key_len);
+            if(NULL != value) memcpy(data + key_len, value, value_len);
+            for(i = 0; i < (int)node->level; i++){
+                *last[i] = offset;
+                last[i] = &node->next[i];
+            }
+            if((int)node->level > level) level = node->level;
+            offset += node_size;
+        }
+        header->magic = SKIPLIST_IMAGE_MAGIC;
+        header->size = offset;
+        header->count = rank;
+        header->level = level;
+        *size = offset;
+        return base;
+    err:
+        free(base);
+        return NULL;
+    }
+
+    //writes the image of 'sl' to 'path' through a temporary file renamed over it, so processes still
+    //mapping the old image keep reading it
+    static inline int skiplist_image_save(struct skiplist *sl, skiplist_image_fields *fields, const char *path){
+        size_t size = 0, len = strlen(path);
+        char *tmp = NULL;
+        FILE *file = NULL;
+        void *base = skiplist_image_build(sl, fields, &size);
+        if(NULL == base) return SKIPLIST_ERR;
+        if(NULL == (tmp = (char *)malloc(len + 5))) goto err;
+        memcpy(tmp, path, len);
+        memcpy(tmp + len, ".tmp", 5);
+        if(NULL == (file = fopen(tmp, "wb"))) goto err;
+        if(1 != fwrite(base, size, 1, file) || 0 != fflush(file) || 0 != fsync(fileno(file))){
+            fclose(file);
+            unlink(tmp);
+            goto err;
+        }
+        fclose(file);
+        if(0 != rename(tmp, path)){
+            unlink(tmp);
+            goto err;
+        }
+        free(tmp);
+        free(base);
+        return SKIPLIST_OK;
+    err:
+        free(tmp);
+        free(base);
+        return SKIPLIST_ERR;
+    }
+
+    //serves an image already in memory, e.g. from skiplist_image_build; 'base' must stay valid and 8 byte aligned
+    static inline int skiplist_image_attach(struct skiplist_image *img, const void *base, size_t size, skiplist_image_cmp *cmp){
+        const struct skiplist_image_header *header = (const struct skiplist_image_header *)base;
+        if(size < sizeof(*header) || SKIPLIST_IMAGE_MAGIC != header->magic || size != header->size ||
+                header->level < 1 || header->level > SKIPLIST_MAXLEVEL){
+            return SKIPLIST_ERR;
+        }
+        img->base = (const char *)base;
+        img->size = size;
+        img->mapped = 0;
+        img->cmp = NULL != cmp ? cmp : skiplist_image_memcmp;
+        return SKIPLIST_OK;
+    }
+
+    //maps the image at 'path' read-only and shared, the page cache backs every process opening it
+    static inline int skiplist_image_open(struct skiplist_image *img, const char *path, skiplist_image_cmp *cmp){
+        struct stat st;
+        int fd = open(path, O_RDONLY);
+        if(fd < 0) return SKIPLIST_ERR;
+        if(0 != fstat(fd, &st) || st.st_size < (off_t)sizeof(struct skiplist_image_header)){
+            close(fd);
+            return SKIPLIST_ERR;
+        }
+        void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); //the mapping holds its own reference
+        if(MAP_FAILED == base) return SKIPLIST_ERR;
+        if(SKIPLIST_OK != skiplist_image_attach(img, base, st.st_size, cmp)){
+            munmap(base, st.st_size);
+            return SKIPLIST_ERR;
+        }
+        img->mapped = 1;
+        return SKIPLIST_OK;
+    }
+
+    static inline void skiplist_image_close(struct skiplist_image *img){
+        if(img->mapped) munmap((void *)img->base, img->size);
+        img->base = NULL;
+        img->size = 0;
+        img->mapped = 0;
+    }
+
+    static inline const struct skiplist_image_header *skiplist_image_header(const struct skiplist_image *img){
+        return (const struct skiplist_image_header *)img->base;
+    }
+
+    static inline const struct skiplist_image_node *skiplist_image_at(const struct skiplist_image *img, uint64_t offset){
+        return 0 == offset ? NULL : (const struct skiplist_image_node *)(img->base + offset);
+    }
+
+    static inline const void *skiplist_image_key(const struct skiplist_image_node *node){
+        return &node->next[node->level];
+    }
+
+    //NULL if the value written was NULL
+    static inline const void *skiplist_image_value(const struct skiplist_image_node *node){
+        if(node->flags & SKIPLIST_IMAGE_NULL_VALUE) return NULL;
+        return (const char *)&node->next[node->level] + node->key_len;
+    }
+
+    static inline const struct skiplist_image_node *skiplist_image_first(const struct skiplist_image *img){
+        return skiplist_image_at(img, skiplist_image_header(img)->head[0]);
+    }
+
+    static inline const struct skiplist_image_node *skiplist_image_next(const struct skiplist_image *img,
+                                                                        const struct skiplist_image_node *node){
+        return skiplist_image_at(img, node->next[0]);
+    }
+
+    //last node below 'key' (bound 0) or not above it (bound 1), NULL if none
+    static inline const struct skiplist_image_node *skiplist_image_floor(const struct skiplist_image *img,
+                                                                        const void *key, size_t key_len, int bound){
+        const struct skiplist_image_header *header = skiplist_image_header(img);
+        const struct skiplist_image_node *res = NULL, *next_node = NULL;
+        const uint64_t *links = header->head;
+        int i = header->level - 1;
+        for(; i >= 0; i--){
+            while(NULL != (next_node = skiplist_image_at(img, links[i])) &&
+                    bound > img->cmp(skiplist_image_key(next_node), next_node->key_len, key, key_len)){
+                res = next_node;
+                links = next_node->next;
+            }
+        }
+        return res;
+    }
+
+    static inline const struct skiplist_image_node *skiplist_image_seek_ge(const struct skiplist_image *img,
+                                                                            const void *key, size_t key_len){
+        const struct skiplist_image_node *node = skiplist_image_floor(img, key, key_len, 0);
+        return NULL != node ? skiplist_image_next(img, node) : skiplist_image_first(img);
+    }
+
+    static inline const struct skiplist_image_node *skiplist_image_get(const struct skiplist_image *img,
+                                                                        const void *key, size_t key_len){
+        const struct skiplist_image_node *node = skiplist_image_seek_ge(img, key, key_len);
+        if(NULL != node && 0 == img->cmp(skiplist_image_key(node), node->key_len, key, key_len)) return node;
+        return NULL;
+    }
+
+    #define SKIPLIST_IMAGE_FOREACH(img, pos) \
+        for ((pos) = skiplist_image_first(img); NULL != (pos); (pos) = skiplist_image_next((img), (pos)))
+
+#ifdef __cplusplus
+}
+#endif
+#endif
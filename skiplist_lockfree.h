@@ -0,0 +1,235 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_LOCKFREE__
+#define __SKIPLIST_LOCKFREE__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdlib.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include "skiplist.h"
+    #include "skiplist_epoch.h"
+
+    //lock-free variant: next pointers carry a mark bit meaning "deleted on this level", the end of a level is NULL
+    //every call must run between skiplist_epoch_enter and skiplist_epoch_exit of the calling thread
+
+    #define LFSKIPLIST_MARK(p) ((uintptr_t)(p) | 1)
+    #define LFSKIPLIST_UNMARK(p) ((struct lfskiplist_node *)((uintptr_t)(p) & ~(uintptr_t)1))
+    #define LFSKIPLIST_MARKED(p) ((uintptr_t)(p) & 1)
+
+    #define LFSKIPLIST_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+    #define LFSKIPLIST_CAS(p, expected, desired) \
+        ({ \
+            uintptr_t __expected = (uintptr_t)(expected); \
+            __atomic_compare_exchange_n(&(p), &__expected, (uintptr_t)(desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); \
+        })
+
+    //the node must be the last member of the embedding struct, same as struct skiplist_node
+    struct lfskiplist_node{
+        struct skiplist_epoch_entry retire;
+        int level;
+        int refs;         //the inserter and the list, whoever drops the last one retires the node
+        uintptr_t next[];
+    };
+
+    struct lfskiplist{
+        int busy;
+        int level;    //only grows, levels above it are empty
+        int maxlevel;
+        skiplist_cmp_item *cmp_item;
+        skiplist_epoch_free *free_entry; //receives &node->retire
+        struct skiplist_epoch *epoch;
+        union{
+            struct lfskiplist_node header[1];
+            char header_storage[sizeof(struct lfskiplist_node) + SKIPLIST_MAXLEVEL * sizeof(uintptr_t)];
+        };
+    };
+
+    static inline void lfskiplist_init(struct lfskiplist *sl, skiplist_cmp_item *cmp_item, skiplist_epoch_free *free_entry,
+                                        struct skiplist_epoch *epoch){
+        sl->busy = 0;
+        sl->level = 1;
+        sl->maxlevel = SKIPLIST_MAXLEVEL;
+        sl->cmp_item = cmp_item;
+        sl->free_entry = free_entry;
+        sl->epoch = epoch;
+        sl->header->level = SKIPLIST_MAXLEVEL;
+        sl->header->refs = 1;
+        int i = 0;
+        for(; i < SKIPLIST_MAXLEVEL; i++){
+            sl->header->next[i] = 0;
+        }
+    }
+
+    static inline void *lfskiplist_node_alloc(struct lfskiplist *sl, size_t size, size_t offset){
+        int level = SKIPLIST_RANDOM_LEVEL(sl->maxlevel);
+        size_t need = offset + offsetof(struct lfskiplist_node, next) + level * sizeof(uintptr_t);
+        char *item = (char *)calloc(1, need > size ? need : size);
+        if(NULL == item) return NULL;
+        ((struct lfskiplist_node *)(item + offset))->level = level;
+        return item;
+    }
+
+    #define LFSKIPLIST_NODE_ALLOC(sl, type, member) \
+        ((type *)lfskiplist_node_alloc((sl), sizeof(type), offsetof(type, member)))
+
+    static inline void lfskiplist_release(struct lfskiplist *sl, struct skiplist_epoch_thread *thr, struct lfskiplist_node *node){
+        if(0 == __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL)){
+            node->retire.free_entry = sl->free_entry;
+            skiplist_epoch_retire(sl->epoch, thr, &node->retire);
+        }
+    }
+
+    //fills the predecessors and successors of 'node' on every level, unlinking marked nodes on the way
+    static inline int lfskiplist_find(struct lfskiplist *sl, struct lfskiplist_node *node,
+                                        struct lfskiplist_node **preds, struct lfskiplist_node **succs){
+    retry:;
+        struct lfskiplist_node *pred = sl->header, *curr = NULL, *succ = NULL;
+        int i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE) - 1;
+        for(; i >= 0; i--){
+            curr = LFSKIPLIST_UNMARK(LFSKIPLIST_LOAD(pred->next[i]));
+            while(NULL != curr){
+                uintptr_t raw = LFSKIPLIST_LOAD(curr->next[i]);
+                while(LFSKIPLIST_MARKED(raw)){ //curr is deleted on this level, snip it
+                    succ = LFSKIPLIST_UNMARK(raw);
+                    if(!LFSKIPLIST_CAS(pred->next[i], curr, succ)) goto retry;
+                    curr = succ;
+                    if(NULL == curr) break;
+                    raw = LFSKIPLIST_LOAD(curr->next[i]);
+                }
+                if(NULL == curr || 0 <= sl->cmp_item(curr, node)) break;
+                pred = curr;
+                curr = LFSKIPLIST_UNMARK(raw);
+            }
+            preds[i] = pred;
+            succs[i] = curr;
+        }
+        return NULL != succs[0] && 0 == sl->cmp_item(succs[0], node);
+    }
+
+    static inline struct lfskiplist_node *lfskiplist_get(struct lfskiplist *sl, struct lfskiplist_node *node){
+        struct lfskiplist_node *pred = sl->header, *curr = NULL;
+        int i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE) - 1;
+        for(; i >= 0; i--){
+            curr = LFSKIPLIST_UNMARK(LFSKIPLIST_LOAD(pred->next[i]));
+            while(NULL != curr){
+                uintptr_t raw = LFSKIPLIST_LOAD(curr->next[i]);
+                if(LFSKIPLIST_MARKED(raw)){ //skip deleted nodes without helping
+                    curr = LFSKIPLIST_UNMARK(raw);
+                    continue;
+                }
+                if(0 <= sl->cmp_item(curr, node)) break;
+                pred = curr;
+                curr = LFSKIPLIST_UNMARK(raw);
+            }
+        }
+        if(NULL != curr && 0 == sl->cmp_item(curr, node) && !LFSKIPLIST_MARKED(LFSKIPLIST_LOAD(curr->next[0]))){
+            return curr;
+        }
+        return NULL;
+    }
+
+    static inline int lfskiplist_put(struct lfskiplist *sl, struct skiplist_epoch_thread *thr, struct lfskiplist_node *new_node){
+        struct lfskiplist_node *preds[SKIPLIST_MAXLEVEL], *succs[SKIPLIST_MAXLEVEL];
+        if(new_node->level < 1) return SKIPLIST_ERR;
+        if(new_node->level > sl->maxlevel){
+            new_node->level = sl->maxlevel;
+        }
+        new_node->refs = 2;
+        int i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE);
+        while(i < new_node->level && !__atomic_compare_exchange_n(&sl->level, &i, new_node->level, 1,
+                                                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)); //raise before linking
+
+        do{
+            if(lfskiplist_find(sl, new_node, preds, succs)){
+                return SKIPLIST_ERR;
+            }
+            for(i = 0; i < new_node->level; i++){
+                __atomic_store_n(&new_node->next[i], (uintptr_t)succs[i], __ATOMIC_RELAXED);
+            }
+        }while(!LFSKIPLIST_CAS(preds[0]->next[0], succs[0], new_node)); //linearization point
+        __atomic_add_fetch(&sl->busy, 1, __ATOMIC_RELAXED);
+
+        for(i = 1; i < new_node->level; i++){
+            for(;;){
+                uintptr_t raw = LFSKIPLIST_LOAD(new_node->next[i]);
+                if(LFSKIPLIST_MARKED(raw)) goto done; //deleted while linking
+                if(LFSKIPLIST_UNMARK(raw) != succs[i] && !LFSKIPLIST_CAS(new_node->next[i], raw, succs[i])) continue;
+                if(LFSKIPLIST_CAS(preds[i]->next[i], succs[i], new_node)) break;
+                lfskiplist_find(sl, new_node, preds, succs);
+                if(succs[0] != new_node) goto done;
+            }
+        }
+    done:
+        if(LFSKIPLIST_MARKED(LFSKIPLIST_LOAD(new_node->next[0]))){
+            lfskiplist_find(sl, new_node, preds, succs); //make sure no level we linked late still points at it
+        }
+        lfskiplist_release(sl, thr, new_node);
+        return SKIPLIST_OK;
+    }
+
+    //unlinks the node equal to 'node', it is freed through 'free_item' once no thread can still see it
+    static inline int lfskiplist_del(struct lfskiplist *sl, struct skiplist_epoch_thread *thr, struct lfskiplist_node *node){
+        struct lfskiplist_node *preds[SKIPLIST_MAXLEVEL], *succs[SKIPLIST_MAXLEVEL];
+        if(!lfskiplist_find(sl, node, preds, succs)){
+            return SKIPLIST_ERR;
+        }
+        struct lfskiplist_node *victim = succs[0];
+        int i = victim->level - 1;
+        for(; i >= 1; i--){
+            uintptr_t raw = LFSKIPLIST_LOAD(victim->next[i]);
+            while(!LFSKIPLIST_MARKED(raw) && !LFSKIPLIST_CAS(victim->next[i], raw, LFSKIPLIST_MARK(raw))){
+                raw = LFSKIPLIST_LOAD(victim->next[i]);
+            }
+        }
+        uintptr_t raw = LFSKIPLIST_LOAD(victim->next[0]);
+        for(;;){
+            if(LFSKIPLIST_MARKED(raw)) return SKIPLIST_ERR; //another thread won the delete
+            if(LFSKIPLIST_CAS(victim->next[0], raw, LFSKIPLIST_MARK(raw))) break;
+            raw = LFSKIPLIST_LOAD(victim->next[0]);
+        }
+        __atomic_sub_fetch(&sl->busy, 1, __ATOMIC_RELAXED);
+        lfskiplist_find(sl, victim, preds, succs); //physically unlink it on every level
+        lfskiplist_release(sl, thr, victim);
+        return SKIPLIST_OK;
+    }
+
+    //frees every node, single threaded teardown
+    static inline void lfskiplist_destroy(struct lfskiplist *sl){
+        struct lfskiplist_node *pos = LFSKIPLIST_UNMARK(sl->header->next[0]);
+        while(NULL != pos){
+            struct lfskiplist_node *next = LFSKIPLIST_UNMARK(pos->next[0]);
+            sl->free_entry(&pos->retire);
+            pos = next;
+        }
+        int i = 0;
+        for(; i < SKIPLIST_MAXLEVEL; i++){
+            sl->header->next[i] = 0;
+        }
+        sl->busy = 0;
+        sl->level = 1;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+#endif
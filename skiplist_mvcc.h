@@ -0,0 +1,245 @@
+/*
+ *
+ * Copyright (c) 2021, Joel
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SKIPLIST_MVCC__
+#define __SKIPLIST_MVCC__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    #include <stdint.h>
+
+    #include "skiplist.h"
+
+    //multi-version list: every put and delete links a new node stamped with the next sequence number,
+    //versions of a key sit next to each other newest first and a delete is a tombstone node. A snapshot
+    //reads the list as of its sequence number; versions and tombstones are unlinked (and handed to the
+    //reclaim callback) as soon as no snapshot can see them, so a node a snapshot stands on stays linked
+    //while writes go on around it. The writer never waits for readers. Snapshots, scans and writes run
+    //on one thread (or under one lock); the list itself may be SKIPLIST_SWMR with reclaim going through
+    //skiplist_epoch.h, but snapshots are taken and released on the writer side
+
+    #define SKIPLIST_VERSION_TOMBSTONE 1
+
+    //must sit right before the node: struct item{ ...; struct skiplist_version version; struct skiplist_node node; }
+    struct skiplist_version{
+        uint64_t seq;       //stamped when linked, the search seq for probes
+        unsigned int flags;
+    };
+
+    #define skiplist_version_of(node) \
+        ((struct skiplist_version *)((char *)(node) - sizeof(struct skiplist_version)))
+
+    #define SKIPLIST_VERSION_CHECK(type, version, node) \
+        _Static_assert(offsetof(type, node) == offsetof(type, version) + sizeof(struct skiplist_version), \
+                "struct skiplist_version must sit right before the node")
+
+    //tie break for cmp_item once the keys are equal: newer versions first, so the first node >= a probe
+    //stamped with seq s is the newest version not above s. Unversioned nodes all have seq 0 and stay equal
+    static inline int skiplist_version_cmp(void *k1, void *k2){
+        uint64_t s1 = skiplist_version_of(k1)->seq, s2 = skiplist_version_of(k2)->seq;
+        return s1 == s2 ? 0 : (s1 > s2 ? -1 : 1);
+    }
+
+    struct skiplist_snapshot{
+        uint64_t seq; //sees the versions stamped up to here
+        struct skiplist_snapshot *prev;
+        struct skiplist_snapshot *next;
+    };
+
+    typedef void skiplist_mvcc_reclaim(struct skiplist_node *node, void *arg);
+
+    //side state of a versioned list, passed along with it like a finger
+    struct skiplist_mvcc{
+        uint64_t seq;             //last stamped
+        unsigned long garbage;    //linked tombstones and shadowed versions
+        unsigned long kept;       //garbage the last collect had to keep
+        struct skiplist_snapshot snapshots; //sentinel, oldest first
+        skiplist_cmp_item *cmp_key; //like cmp_item without the version tie break
+        skiplist_mvcc_reclaim *reclaim;
+        void *arg;
+    };
+
+    static inline void skiplist_mvcc_init(struct skiplist_mvcc *mv, skiplist_cmp_item *cmp_key,
+                                            skiplist_mvcc_reclaim *reclaim, void *arg){
+        mv->seq = 0;
+        mv->garbage = 0;
+        mv->kept = 0;
+        mv->snapshots.seq = 0;
+        mv->snapshots.prev = mv->snapshots.next = &mv->snapshots;
+        mv->cmp_key = cmp_key;
+        mv->reclaim = reclaim;
+        mv->arg = arg;
+    }
+
+    //1 if a snapshot sees a version stamped 'lo' whose next newer version is stamped 'hi'
+    static inline int skiplist_mvcc_pinned(struct skiplist_mvcc *mv, uint64_t lo, uint64_t hi){
+        struct skiplist_snapshot *snap = mv->snapshots.next;
+        for(; &mv->snapshots != snap && snap->seq < hi; snap = snap->next){
+            if(snap->seq >= lo) return 1;
+        }
+        return 0;
+    }
+
+    static inline void skiplist_mvcc_drop(struct skiplist *sl, struct skiplist_mvcc *mv, struct skiplist_node *node){
+        skiplist_del(sl, node);
+        mv->garbage -= 1;
+        if(NULL != mv->reclaim) mv->reclaim(node, mv->arg);
+    }
+
+    //unlinks the older versions of 'head' (the newest of its key) that no snapshot sees, then the
+    //tombstones left at the end of the chain with nothing older to hide; returns the next key's first node
+    static inline struct skiplist_node *skiplist_mvcc_prune(struct skiplist *sl, struct skiplist_mvcc *mv, struct skiplist_node *head){
+        uint64_t hi = skiplist_version_of(head)->seq;
+        struct skiplist_node *pos = head->link[0].next, *next = NULL, *last = head;
+        for(; sl->header != pos && 0 == mv->cmp_key(pos, head); pos = next){
+            uint64_t lo = skiplist_version_of(pos)->seq;
+            next = pos->link[0].next;
+            if(skiplist_mvcc_pinned(mv, lo, hi)){
+                last = pos;
+            }else{
+                skiplist_mvcc_drop(sl, mv, pos);
+            }
+            hi = lo;
+        }
+        while(skiplist_version_of(last)->flags & SKIPLIST_VERSION_TOMBSTONE){
+            struct skiplist_node *prev = last->prev;
+            skiplist_mvcc_drop(sl, mv, last);
+            if(head == last) break;
+            last = prev;
+        }
+        return pos;
+    }
+
+    //links 'node' as the newest version of its key (the first one if absent), or a tombstone over
+    //the live version; SKIPLIST_ERR if there is nothing live to delete, and 'node' is not taken
+    static inline int skiplist_mvcc_link(struct skiplist *sl, struct skiplist_mvcc *mv, struct skiplist_node *node, unsigned int flags){
+        if(!SKIPLIST_NODE_FITS(sl, node)) return SKIPLIST_ERR;
+        struct skiplist_version *version = skiplist_version_of(node);
+        struct skiplist_node *tracks[SKIPLIST_MAXLEVEL] = { 0, };
+        int ranks[SKIPLIST_MAXLEVEL] = { 0, };
+        version->seq = mv->seq + 1; //above every version, so it lands right before the current newest
+        version->flags = flags;
+        SKIPLIST_TRACK_RANK(sl, node, tracks, ranks);
+        struct skiplist_node *old_node = tracks[0]->link[0].next;
+        int shadows = sl->header != old_node && 0 == mv->cmp_key(old_node, node);
+        int live = shadows && !(skiplist_version_of(old_node)->flags & SKIPLIST_VERSION_TOMBSTONE);
+        if((flags & SKIPLIST_VERSION_TOMBSTONE) && !live) return SKIPLIST_ERR;
+        skiplist_link(sl, tracks, ranks, node);
+        mv->seq += 1;
+        mv->garbage += (live ? 1 : 0) + ((flags & SKIPLIST_VERSION_TOMBSTONE) ? 1 : 0);
+        if(shadows) skiplist_mvcc_prune(sl, mv, node);
+        return SKIPLIST_OK;
+    }
+
+    static inline int skiplist_mvcc_put(struct skiplist *sl, struct skiplist_mvcc *mv, struct skiplist_node *node){
+        return skiplist_mvcc_link(sl, mv, node, 0);
+    }
+
+    //'tombstone' carries the key; once linked it belongs to the list and may be reclaimed right away
+    static inline int skiplist_mvcc_del(struct skiplist *sl, struct skiplist_mvcc *mv, struct skiplist_node *tombstone){
+        return skiplist_mvcc_link(sl, mv, tombstone, SKIPLIST_VERSION_TOMBSTONE);
+    }
+
+    //the version 'snap' sees at or after 'node', skipping versions stamped after it, tombstoned keys
+    //and the older versions of a key; NULL at the end. A NULL 'snap' reads the latest versions
+    static inline struct skiplist_node *skiplist_snapshot_visible(struct skiplist *sl, struct skiplist_mvcc *mv,
+                                            struct skiplist_snapshot *snap, struct skiplist_node *node){
+        uint64_t seq = NULL != snap ? snap->seq : mv->seq;
+        while(sl->header != node){
+            struct skiplist_version *version = skiplist_version_of(node);
+            if(version->seq > seq){ //too new, an older version of the same key may follow
+                node = node->link[0].next;
+                continue;
+            }
+            if(!(version->flags & SKIPLIST_VERSION_TOMBSTONE)) return node;
+            struct skiplist_node *deleted = node;
+            do{
+                node = node->link[0].next;
+            }while(sl->header != node && 0 == mv->cmp_key(node, deleted));
+        }
+        return NULL;
+    }
+
+    //the version of the key of 'probe' that 'snap' sees, NULL if it sees none; the probe's version is overwritten
+    static inline struct skiplist_node *skiplist_snapshot_get(struct skiplist *sl, struct skiplist_mvcc *mv,
+                                            struct skiplist_snapshot *snap, struct skiplist_node *probe){
+        struct skiplist_version *version = skiplist_version_of(probe);
+        version->seq = NULL != snap ? snap->seq : mv->seq;
+        version->flags = 0;
+        struct skiplist_node *node = skiplist_floor(sl, probe, 0, NULL)->link[0].next;
+        if(sl->header == node || 0 != mv->cmp_key(node, probe) ||
+                (skiplist_version_of(node)->flags & SKIPLIST_VERSION_TOMBSTONE)){
+            return NULL;
+        }
+        return node;
+    }
+
+    //first version 'snap' sees with a key >= the key of 'probe' (from the first key if NULL), NULL if none
+    static inline struct skiplist_node *skiplist_snapshot_seek(struct skiplist *sl, struct skiplist_mvcc *mv,
+                                            struct skiplist_snapshot *snap, struct skiplist_node *probe){
+        struct skiplist_node *node = sl->header->link[0].next;
+        if(NULL != probe){
+            skiplist_version_of(probe)->seq = NULL != snap ? snap->seq : mv->seq;
+            skiplist_version_of(probe)->flags = 0;
+            node = skiplist_floor(sl, probe, 0, NULL)->link[0].next;
+        }
+        return skiplist_snapshot_visible(sl, mv, snap, node);
+    }
+
+    //the version 'snap' sees after 'node', which must be one it saw; writes in between are fine
+    static inline struct skiplist_node *skiplist_snapshot_next(struct skiplist *sl, struct skiplist_mvcc *mv,
+                                            struct skiplist_snapshot *snap, struct skiplist_node *node){
+        struct skiplist_node *next = node->link[0].next;
+        while(sl->header != next && 0 == mv->cmp_key(next, node)){ //older versions of the same key
+            next = next->link[0].next;
+        }
+        return skiplist_snapshot_visible(sl, mv, snap, next);
+    }
+
+    //unlinks every version no snapshot sees, one pass
+    static inline void skiplist_mvcc_collect(struct skiplist *sl, struct skiplist_mvcc *mv){
+        struct skiplist_node *pos = sl->header->link[0].next;
+        while(sl->header != pos){
+            pos = skiplist_mvcc_prune(sl, mv, pos);
+        }
+        mv->kept = mv->garbage;
+    }
+
+    //pins the versions current now until skiplist_snapshot_release
+    static inline void skiplist_snapshot_open(struct skiplist_mvcc *mv, struct skiplist_snapshot *snap){
+        snap->seq = mv->seq;
+        snap->prev = mv->snapshots.prev;
+        snap->next = &mv->snapshots;
+        mv->snapshots.prev->next = snap;
+        mv->snapshots.prev = snap;
+    }
+
+    //collects once the versions left behind outgrow an eighth of the list, so sweeps stay amortized
+    static inline void skiplist_snapshot_release(struct skiplist *sl, struct skiplist_mvcc *mv, struct skiplist_snapshot *snap){
+        snap->prev->next = snap->next;
+        snap->next->prev = snap->prev;
+        if(mv->garbage > mv->kept + (unsigned long)sl->busy / 8){
+            skiplist_mvcc_collect(sl, mv);
+        }
+    }
+
+#ifdef __cplusplus
+}
+#endif
+#endif